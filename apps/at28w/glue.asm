@@ -1,8 +1,8 @@
 ; at28w - Write to AT28 EEPROM
 ;
 ; Write data from the active block device into an eeprom device geared as
-; regular memory. Implements write polling to know when the next byte can be
-; written and verifies that data is written properly.
+; regular memory. Writes data in 64 bytes pages, uses data polling to know when
+; the next page can be written and verifies that data is written properly.
 ;
 ; Optionally receives a word argument that specifies the number or bytes to
 ; write. If unspecified, will write until max bytes (0x2000) is reached or EOF
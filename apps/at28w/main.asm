@@ -1,13 +1,21 @@
 ; *** Consts ***
-; Memory address where the AT28 is configured to start
+; Memory address where the AT28 is configured to start. Must be aligned to
+; AT28W_PAGESIZE.
 .equ	AT28W_MEMSTART		0x2000
 
+; Bytes written less than 150us apart and within the same 64 bytes page are
+; written together in a single write cycle.
+.equ	AT28W_PAGESIZE		0x40
+
 ; Value mismatch during validation
 .equ	AT28W_ERR_MISMATCH	0x10
 
 ; *** Variables ***
 .equ	AT28W_MAXBYTES	AT28W_RAMSTART
-.equ	AT28W_RAMEND	AT28W_MAXBYTES+2
+; Data for the page we're about to write. We read it from the blockdev before
+; writing because blockdev reads might be slower than 150us.
+.equ	AT28W_PAGEBUF	AT28W_MAXBYTES+2
+.equ	AT28W_RAMEND	AT28W_PAGEBUF+AT28W_PAGESIZE
 ; *** Code ***
 
 at28wMain:
@@ -29,44 +37,81 @@ at28wInner:
 	ld	c, a
 	ld	hl, AT28W_MEMSTART
 	call	at28wBCZero
-	jr	nz, .loop
+	jr	nz, .page
 	; BC is zero, default to 0x2000 (8k, the size of the AT28)
 	ld	bc, 0x2000
-.loop:
+.page:
+	; Read up to a page of data in AT28W_PAGEBUF. Byte count goes in D.
+	push	hl		; --> lvl 1
+	ld	hl, AT28W_PAGEBUF
+	ld	d, 0
+.read:
+	call	at28wBCZero
+	jr	z, .readend
 	call	blkGetC
-	jr	nz, .loopend
+	jr	nz, .readend
 	ld	(hl), a
-	ld	e, a		; save expected data for verification
-	; initiate polling
-	ld	a, (hl)
-	ld	d, a
-.wait:
-	; as long as writing operation is running, IO/6 will toggle at each
-	; read attempt. We know that write is finished when we read the same
-	; value twice.
-	ld	a, (hl)
-	cp	d
-	jr	z, .waitend
-	ld	d, a
-	jr	.wait
-.waitend:
-
-	; same value was read twice. A contains our final value for this memory
-	; address. Let's compare with what we're written.
-	cp	e
-	jr	nz, .mismatch
 	inc	hl
 	dec	bc
-	call	at28wBCZero
-	jr	nz, .loop
-
-.loopend:
-	; We're finished. Success!
-	xor	a
+	inc	d
+	ld	a, d
+	cp	AT28W_PAGESIZE
+	jr	nz, .read
+.readend:
+	pop	hl		; <-- lvl 1
+	ld	a, d
+	or	a
+	ret	z		; nothing left to write. We're finished. Success!
+	push	bc
+	ld	b, d
+	call	at28wWritePage
+	pop	bc
+	jr	z, .page
+	; mismatch
+	ld	a, AT28W_ERR_MISMATCH
 	ret
 
-.mismatch:
-	ld	a, AT28W_ERR_MISMATCH
+; Write B bytes from AT28W_PAGEBUF to the AT28 at HL, wait until the write is
+; over and verify it. Z is set on success. HL is advanced by B.
+at28wWritePage:
+	push	bc
+	push	de
+	push	hl		; --> lvl 1
+	push	bc		; --> lvl 2
+	; Write all bytes in a burst so that they're part of the same write
+	; cycle.
+	ex	de, hl
+	ld	hl, AT28W_PAGEBUF
+	ld	c, b
+	ld	b, 0
+	ldir
+	; Data polling: as long as the write cycle runs, reading the last byte
+	; we've written gives us the complement of its bit 7.
+	dec	hl
+	ld	a, (hl)
+	ex	de, hl
+	dec	hl
+	ld	e, a
+.wait:
+	ld	a, (hl)
+	xor	e
+	and	0x80
+	jr	nz, .wait
+	; Write cycle is over, let's verify what we've written.
+	pop	bc		; <-- lvl 2
+	pop	hl		; <-- lvl 1
+	ld	de, AT28W_PAGEBUF
+.verify:
+	ld	a, (de)
+	cp	(hl)
+	jr	nz, .end	; Z is unset
+	inc	hl
+	inc	de
+	djnz	.verify
+	; Z is set by our last cp
+.end:
+	pop	de
+	pop	bc
 	ret
 
 at28wBCZero:
@@ -75,4 +120,3 @@ at28wBCZero:
 	ret	nz
 	cp	c
 	ret
-
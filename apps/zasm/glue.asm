@@ -1,7 +1,8 @@
 ; zasm
 ;
 ; Reads input from specified blkdev ID, assemble the binary in two passes and
-; spit the result in another specified blkdev ID.
+; spit the result in another specified blkdev ID. An optional third blkdev ID
+; receives a report of what was assembled (see report.asm).
 ;
 ; We don't buffer the whole source in memory, so we need our input blkdev to
 ; support Seek so we can read the file a second time. So, for input, we need
@@ -90,5 +91,7 @@ jp	zasmMain
 .inc "zasm/expr.asm"
 .equ	SYM_RAMSTART	DIREC_RAMEND
 .inc "zasm/symbol.asm"
-.equ	ZASM_RAMSTART	SYM_RAMEND
+.equ	REPORT_RAMSTART	SYM_RAMEND
+.inc "zasm/report.asm"
+.equ	ZASM_RAMSTART	REPORT_RAMEND
 .inc "zasm/main.asm"
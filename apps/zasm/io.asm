@@ -107,6 +107,7 @@ ioGetC:
 	ld	(IO_IN_INCLUDE), a	; A already 0
 	ld	(IO_INC_LINENO), a
 	ld	(IO_INC_LINENO+1), a
+	call	reportIncludeEnd
 	; continue on to "normal" reading. We don't want to return our zero
 .normalmode:
 	; normal mode, read from IN stream
@@ -191,18 +192,23 @@ ioResetCounters:
 	ld	(IO_SAVED_LINENO), hl
 	ret
 
-; always in absolute mode (A = 0)
+; always in absolute mode (A = 0). Positions are 16-bit.
 _ioSeek:
+	push	de
+	ld	de, 0
 	call	ioInInclude
 	ld	a, 0		; don't alter flags
 	jr	nz, .include
 	; normal mode, seek in IN stream
 	ld	ix, IO_IN_BLK
-	jp	_blkSeek
+	jr	.seek
 .include:
 	; We're in "include mode", seek in FS
 	ld	ix, IO_INCLUDE_BLK
-	jp	_blkSeek	; returns
+.seek:
+	call	_blkSeek
+	pop	de
+	ret
 
 _ioTell:
 	call	ioInInclude
@@ -228,15 +234,19 @@ ioOpenInclude:
 	call	ioPrintLN
 	call	fsFindFN
 	ret	nz
+	call	reportInclude
 	ld	ix, IO_INCLUDE_HDL
 	call	fsOpen
 	ld	a, 1
 	ld	(IO_IN_INCLUDE), a
 	ld	hl, 0
 	ld	(IO_INC_LINENO), hl
+	push	de
+	ld	de, 0
 	xor	a
 	ld	ix, IO_INCLUDE_BLK
 	call	_blkSeek
+	pop	de
 	cp	a		; ensure Z
 	ret
 
@@ -245,9 +255,11 @@ ioOpenInclude:
 ioSpitBin:
 	call	fsFindFN
 	ret	nz
+	push	de
 	push	hl		; --> lvl 1
 	ld	ix, IO_BIN_HDL
 	call	fsOpen
+	ld	de, 0
 	ld	hl, 0
 .loop:
 	ld	ix, IO_BIN_HDL
@@ -258,6 +270,7 @@ ioSpitBin:
 	jr	.loop
 .loopend:
 	pop	hl		; <-- lvl 1
+	pop	de
 	cp	a		; ensure Z
 	ret
 
@@ -15,7 +15,8 @@
 .equ	ZASM_ORG		ZASM_CTX_PC+2
 .equ	ZASM_RAMEND		ZASM_ORG+2
 
-; Takes 2 byte arguments, blkdev in and blkdev out, expressed as IDs.
+; Takes 2 byte arguments, blkdev in and blkdev out, expressed as IDs, and an
+; optional third one, blkdev report (see report.asm), 0 meaning no report.
 ; Read file through blkdev in and outputs its upcodes through blkdev out.
 ; HL is set to the last lineno to be read.
 ; Sets Z on success, unset on error. On error, A contains an error code (ERR_*)
@@ -43,6 +44,8 @@ zasmMain:
 	ld	a, (ZASM_RAMSTART+1)	; blkdev out ID
 	ld	de, IO_OUT_BLK
 	call	blkSel
+	ld	a, (ZASM_RAMSTART+2)	; blkdev report ID
+	call	reportInit
 
 	; Init modules
 	xor	a
@@ -69,11 +72,14 @@ zasmMain:
 	ld	ix, SYM_CONST_REGISTRY
 	call	symClear
 	call	zasmParseFile
+	jr	nz, .end
+	call	reportEnd
+	xor	a		; success
 .end:
 	jp	ioLineNo		; --> HL, --> DE, returns
 
 .argspecs:
-	.db	0b001, 0b001, 0
+	.db	0b001, 0b001, 0b101, 0
 .sFirstPass:
 	.db	"First pass", 0
 .sSecondPass:
@@ -0,0 +1,167 @@
+; report
+;
+; When zasm is given a third blkdev ID, it writes, through that blkdev, a report
+; of what it assembled. It's meant to be read by a program rather than by a
+; human: tools/emul/zasm turns it into byte counts per include file and per
+; label and into a RAM map.
+;
+; The report is written during the second pass. It's a list of lines, each line
+; being a record type character followed by space separated fields. Numbers
+; are 4 digits hex.
+;
+; I <name> <pc>     Entering include file <name>, PC being <pc>
+; E <pc>            Leaving it, PC being <pc>
+; L <name> <value>  Global label, after the second pass
+; C <name> <value>  Constant, after the second pass
+; P <pc>            PC at the end, which ends the report
+
+; *** Variables ***
+.equ	REPORT_BLK	REPORT_RAMSTART
+; blkdev ID of the report, 0 if there's none.
+.equ	REPORT_ID	REPORT_BLK+BLOCKDEV_SIZE
+.equ	REPORT_RAMEND	REPORT_ID+1
+
+; *** Code ***
+
+; Write our report in blkdev ID A. 0 means no report.
+reportInit:
+	ld	(REPORT_ID), a
+	or	a
+	ret	z
+	ld	de, REPORT_BLK
+	jp	blkSel
+
+; Report that we enter include file (HL).
+reportInclude:
+	call	_reportIsOn
+	ret	nz
+	push	af
+	push	hl
+	ld	a, 'I'
+	call	_reportPutC
+	ld	a, ' '
+	call	_reportPutC
+.loop:
+	ld	a, (hl)
+	or	a
+	jr	z, .end
+	call	_reportPutC
+	inc	hl
+	jr	.loop
+.end:
+	pop	hl
+	pop	af
+	jr	_reportPC
+
+; Report that we leave the current include file.
+reportIncludeEnd:
+	call	_reportIsOn
+	ret	nz
+	push	af
+	ld	a, 'E'
+	call	_reportPutC
+	pop	af
+	jr	_reportPC
+
+; Report symbols and final PC.
+reportEnd:
+	call	_reportIsOn
+	ret	nz
+	ld	ix, SYM_GLOBAL_REGISTRY
+	ld	c, 'L'
+	call	_reportReg
+	ld	ix, SYM_CONST_REGISTRY
+	ld	c, 'C'
+	call	_reportReg
+	ld	a, 'P'
+	call	_reportPutC
+	; continue to _reportPC
+
+; Write current PC, then newline.
+_reportPC:
+	push	de
+	push	hl
+	call	zasmGetPC
+	ex	de, hl
+	call	_reportNum
+	pop	hl
+	pop	de
+	jr	_reportNL
+
+; Sets Z if we write to our report, that is, if we have one and we're in the
+; second pass. Local passes don't count.
+_reportIsOn:
+	ld	a, (REPORT_ID)
+	or	a
+	jp	z, unsetZ
+	call	zasmIsFirstPass
+	jp	z, unsetZ
+	cp	a		; ensure Z
+	ret
+
+; Write records of symbol registry IX, with C as record type.
+_reportReg:
+	ld	l, (ix+2)
+	ld	h, (ix+3)
+	ld	b, (hl)		; record count
+	inc	hl
+	push	hl \ pop iy	; records
+	ld	l, (ix)
+	ld	h, (ix+1)	; names
+	ld	a, b
+	or	a
+	ret	z
+.loop:
+	ld	a, c
+	call	_reportPutC
+	ld	a, ' '
+	call	_reportPutC
+	push	bc
+	ld	b, (iy)		; name length
+.name:
+	ld	a, (hl)
+	call	_reportPutC
+	inc	hl
+	djnz	.name
+	pop	bc
+	ld	e, (iy+1)
+	ld	d, (iy+2)
+	call	_reportNum
+	call	_reportNL
+	inc	iy \ inc iy \ inc iy
+	djnz	.loop
+	ret
+
+; Write a space followed by DE in hex.
+_reportNum:
+	ld	a, ' '
+	call	_reportPutC
+	ld	a, d
+	call	_reportHex
+	ld	a, e
+	; continue to _reportHex
+
+; Write A as two hex digits.
+_reportHex:
+	push	af
+	rra \ rra \ rra \ rra
+	call	.nibble
+	pop	af
+.nibble:
+	and	0xf
+	add	a, '0'
+	cp	'9'+1
+	jr	c, _reportPutC
+	add	a, 0x27		; 'a' - '9' - 1
+	jr	_reportPutC
+
+_reportNL:
+	ld	a, 0x0a
+	; continue to _reportPutC
+
+_reportPutC:
+	push	ix
+	ld	ix, REPORT_BLK
+	call	_blkPutC
+	pop	ix
+	ret
@@ -0,0 +1,420 @@
+; blkcache
+;
+; Write-back cache of 256 bytes blocks (the same size as CFS blocks) over a
+; block device.
+;
+; The cache is itself a random access driver (blkcacheGetC and blkcachePutC)
+; that glue code puts in its blockdev list. Reads and writes of that device
+; then go to RAM. The underlying device is only accessed, a whole block at a
+; time, when a block isn't in the cache (it's then loaded in the least recently
+; used entry) or when a modified ("dirty") block is written back.
+;
+; Dirty blocks are written back when they're evicted and when blkcacheFlush is
+; called. Glue code should call it before the underlying device goes away
+; (before it's unmounted or before the machine stops). There's also a shell
+; command for it in blkcache_cmds.asm.
+;
+; When the underlying device can change without going through the cache (for
+; example, when it's backed by files that are edited elsewhere), glue code can
+; call blkcacheDrop, at times when nothing is being read, to make the cache
+; forget what it holds.
+;
+; Hits and misses are counted so that the cache's effectiveness can be
+; measured.
+;
+; *** End of device
+;
+; When loading a block, we read until the underlying GetC fails, so the last
+; block of a device can be partially valid. GetC past the valid part of a block
+; fails. PutC right after it extends it. That byte is written through to the
+; underlying device at once, so that a device that can't grow refuses it then
+; rather than when the block is flushed. Any other access beyond the valid part
+; of a block goes directly to the underlying device.
+;
+; *** Usage
+;
+; Call blkcacheInit, then set the underlying device in BLKCACHE_BLK with
+; blkSel or blkSet (DE=BLKCACHE_BLK). Flush before changing it.
+
+; *** DEFINES ***
+; BLKCACHE_COUNT: Number of cached blocks, at least 2. Each takes 0x107 bytes of
+;                 RAM.
+
+; *** CONSTS ***
+.equ	BLKCACHE_BLOCKSIZE	0x100
+; Entry structure:
+; 3b: block number, which is address bits 31:8, from LSB to MSB.
+; 1b: flags
+; 1b: offset of the last valid byte in the block
+; 2b: address of the block's buffer
+.equ	BLKCACHE_ENTRY_SIZE	7
+.equ	BLKCACHE_VALID		0
+.equ	BLKCACHE_DIRTY		1
+
+; *** VARIABLES ***
+; Underlying device
+.equ	BLKCACHE_BLK		BLKCACHE_RAMSTART
+; Entry indexes, from the most recently used to the least recently used.
+.equ	BLKCACHE_ORDER		BLKCACHE_BLK+BLOCKDEV_SIZE
+; 32-bit counters, little endian
+.equ	BLKCACHE_HITS		BLKCACHE_ORDER+BLKCACHE_COUNT
+.equ	BLKCACHE_MISSES		BLKCACHE_HITS+4
+.equ	BLKCACHE_ENTRIES	BLKCACHE_MISSES+4
+.equ	BLKCACHE_BUFS		BLKCACHE_ENTRIES+BLKCACHE_COUNT*BLKCACHE_ENTRY_SIZE
+.equ	BLKCACHE_RAMEND		BLKCACHE_BUFS+BLKCACHE_COUNT*BLKCACHE_BLOCKSIZE
+
+; *** CODE ***
+
+blkcacheInit:
+	push	ix
+	xor	a
+	ld	hl, BLKCACHE_ORDER
+	ld	b, BLKCACHE_BUFS-BLKCACHE_ORDER
+	call	fill
+	ld	hl, BLKCACHE_ORDER
+	ld	ix, BLKCACHE_ENTRIES
+	ld	de, BLKCACHE_BUFS
+	ld	b, BLKCACHE_COUNT
+.loop:
+	ld	(hl), a
+	inc	hl
+	inc	a
+	ld	(ix+5), e
+	ld	(ix+6), d
+	inc	d		; next buffer is 0x100 bytes further
+	push	de
+	ld	de, BLKCACHE_ENTRY_SIZE
+	add	ix, de
+	pop	de
+	djnz	.loop
+	pop	ix
+	ret
+
+; Reads byte at address DE/HL (see blockdev.asm) in A.
+; Sets Z on success.
+blkcacheGetC:
+	push	hl
+	call	_bcFind
+	jr	nz, .end
+	pop	hl \ push hl
+	ld	a, (ix+4)
+	cp	l
+	jr	c, .error	; L > last valid offset
+	call	_bcPtr
+	ld	a, (hl)
+	cp	a		; ensure Z
+.end:
+	pop	hl
+	ret
+.error:
+	call	unsetZ
+	jr	.end
+
+; Writes A at address DE/HL (see blockdev.asm).
+; Sets Z on success.
+blkcachePutC:
+	push	bc
+	push	hl
+	ld	c, a
+	call	_bcFind
+	jr	nz, .direct
+	ld	a, (ix+4)
+	cp	l
+	jr	nc, .write	; L <= last valid offset
+	; Beyond the valid part. Extend it if we're right after it and if the
+	; device takes the byte.
+	inc	a
+	cp	l
+	jr	nz, .evict
+	ld	a, c
+	call	_bcDevPutC
+	jr	nz, .end
+	inc	(ix+4)
+	call	_bcPtr
+	ld	(hl), c
+	cp	a		; ensure Z
+	jr	.end
+.write:
+	call	_bcPtr
+	ld	(hl), c
+	set	BLKCACHE_DIRTY, (ix+3)
+	cp	a		; ensure Z
+	jr	.end
+.evict:
+	; Writing further in the block would make the cache miss bytes in
+	; between. Write back, forget this block and write directly.
+	call	_bcFlushEntry
+	jr	nz, .end
+	res	BLKCACHE_VALID, (ix+3)
+.direct:
+	ld	a, c
+	call	_bcDevPutC
+.end:
+	ld	a, c		; like other drivers, we preserve A
+	pop	hl
+	pop	bc
+	ret
+
+; Writes all dirty blocks back to the underlying device.
+; Sets Z on success, unsets it if any block couldn't be written.
+blkcacheFlush:
+	push	bc
+	push	ix
+	ld	ix, BLKCACHE_ENTRIES
+	ld	bc, BLKCACHE_COUNT*0x100	; B=count, C=errors
+.loop:
+	call	_bcFlushEntry
+	jr	z, .next
+	inc	c
+.next:
+	push	de
+	ld	de, BLKCACHE_ENTRY_SIZE
+	add	ix, de
+	pop	de
+	djnz	.loop
+	ld	a, c
+	or	a		; Z if no error
+	pop	ix
+	pop	bc
+	ret
+
+; Writes all dirty blocks back and empties the cache so that blocks are read
+; again from the underlying device, which might have changed behind our back.
+; Blocks that couldn't be written back stay in the cache.
+; Sets Z on success, like blkcacheFlush.
+blkcacheDrop:
+	call	blkcacheFlush
+	push	af
+	push	bc
+	push	de
+	push	ix
+	ld	ix, BLKCACHE_ENTRIES
+	ld	de, BLKCACHE_ENTRY_SIZE
+	ld	b, BLKCACHE_COUNT
+.loop:
+	bit	BLKCACHE_DIRTY, (ix+3)
+	jr	nz, .next	; still dirty, keep it
+	res	BLKCACHE_VALID, (ix+3)
+.next:
+	add	ix, de
+	djnz	.loop
+	pop	ix
+	pop	de
+	pop	bc
+	pop	af
+	ret
+
+; Make HL point to offset L in the buffer of entry (IX).
+_bcPtr:
+	ld	a, l
+	ld	l, (ix+5)
+	ld	h, (ix+6)
+	jp	addHL
+
+; Sets Z if entry (IX) is valid and holds the block of address DE/HL.
+_bcMatch:
+	bit	BLKCACHE_VALID, (ix+3)
+	jp	z, unsetZ
+	ld	a, (ix)
+	cp	h
+	ret	nz
+	ld	a, (ix+1)
+	cp	e
+	ret	nz
+	ld	a, (ix+2)
+	cp	d
+	ret
+
+; Make IX point to entry number A.
+_bcEntry:
+	push	de
+	push	hl
+	ld	l, a
+	ld	h, 0
+	ld	d, h
+	ld	e, l
+	add	hl, hl		; *2
+	add	hl, hl		; *4
+	add	hl, hl		; *8
+	sbc	hl, de		; *7, carry is reset by the last add
+	ld	de, BLKCACHE_ENTRIES
+	add	hl, de
+	push	hl \ pop ix
+	pop	hl
+	pop	de
+	ret
+
+; Make IX point to the entry holding the block of address DE/HL, loading that
+; block in the least recently used entry if needed. That entry becomes the most
+; recently used.
+; Sets Z on success, unsets it if the block couldn't be loaded (because it's
+; beyond the end of the device).
+_bcFind:
+	; The most recently used entry is the most likely, check it first.
+	ld	a, (BLKCACHE_ORDER)
+	call	_bcEntry
+	call	_bcMatch
+	jr	nz, .search
+	push	hl
+	ld	hl, BLKCACHE_HITS
+	call	_bcInc
+	pop	hl
+	cp	a		; ensure Z
+	ret
+.search:
+	push	bc
+	push	hl
+	ld	hl, BLKCACHE_ORDER+1
+	ld	b, 1
+.loop:
+	ld	a, (hl)
+	call	_bcEntry
+	ex	(sp), hl	; we need our address back
+	call	_bcMatch
+	ex	(sp), hl
+	jr	z, .found
+	inc	hl
+	inc	b
+	ld	a, b
+	cp	BLKCACHE_COUNT
+	jr	nz, .loop
+	; Not found. HL is past the last index, which is our victim.
+	dec	hl
+	dec	b
+	call	_bcToFront
+	ld	hl, BLKCACHE_MISSES
+	call	_bcInc
+	pop	hl
+	call	_bcLoad
+	pop	bc
+	ret
+.found:
+	call	_bcToFront
+	ld	hl, BLKCACHE_HITS
+	call	_bcInc
+	pop	hl
+	pop	bc
+	cp	a		; ensure Z
+	ret
+
+; Move index at (HL), which is the Bth in BLKCACHE_ORDER, to the front.
+_bcToFront:
+	push	de
+	ld	a, (hl)
+	ld	d, h
+	ld	e, l
+	dec	hl
+	push	bc
+	ld	c, b
+	ld	b, 0
+	lddr
+	pop	bc
+	ld	(BLKCACHE_ORDER), a
+	pop	de
+	ret
+
+; Increase 32-bit counter at (HL)
+_bcInc:
+	inc	(hl)
+	ret	nz
+	inc	hl
+	inc	(hl)
+	ret	nz
+	inc	hl
+	inc	(hl)
+	ret	nz
+	inc	hl
+	inc	(hl)
+	ret
+
+; Write entry (IX) back to the underlying device if it's dirty.
+; Sets Z on success.
+_bcFlushEntry:
+	bit	BLKCACHE_VALID, (ix+3)
+	ret	z		; invalid, nothing to do. Z is set.
+	bit	BLKCACHE_DIRTY, (ix+3)
+	ret	z
+	push	bc
+	push	de
+	push	hl
+	ld	h, (ix)
+	ld	e, (ix+1)
+	ld	d, (ix+2)
+	ld	l, 0
+	ld	c, (ix+5)
+	ld	b, (ix+6)
+.loop:
+	ld	a, (bc)
+	call	_bcDevPutC
+	jr	nz, .end	; stays dirty
+	ld	a, l
+	cp	(ix+4)
+	jr	z, .done	; last valid byte written
+	inc	l
+	inc	bc
+	jr	.loop
+.done:
+	res	BLKCACHE_DIRTY, (ix+3)	; Z is still set
+.end:
+	pop	hl
+	pop	de
+	pop	bc
+	ret
+
+; Write back whatever is in entry (IX) and load the block of address DE/HL in
+; it.
+; Sets Z on success.
+_bcLoad:
+	call	_bcFlushEntry
+	ret	nz		; can't evict, leave it there
+	res	BLKCACHE_VALID, (ix+3)
+	push	bc
+	push	hl
+	ld	(ix), h
+	ld	(ix+1), e
+	ld	(ix+2), d
+	ld	l, 0
+	ld	c, (ix+5)
+	ld	b, (ix+6)
+.loop:
+	call	_bcDevGetC
+	jr	nz, .short
+	ld	(bc), a
+	inc	bc
+	inc	l
+	jr	nz, .loop
+	jr	.full
+.short:
+	; L is the number of bytes we've read
+	ld	a, l
+	or	a
+	jr	z, .fail	; beyond the end of the device
+	dec	a
+	jr	.valid
+.full:
+	ld	a, 0xff
+.valid:
+	ld	(ix+4), a
+	set	BLKCACHE_VALID, (ix+3)
+	cp	a		; ensure Z
+.end:
+	pop	hl
+	pop	bc
+	ret
+.fail:
+	call	unsetZ
+	jr	.end
+
+_bcDevGetC:
+	push	ix
+	ld	ix, BLKCACHE_BLK
+	call	callIXI
+	pop	ix
+	ret
+
+_bcDevPutC:
+	push	ix
+	ld	ix, BLKCACHE_BLK+2
+	call	callIXI
+	pop	ix
+	ret
@@ -0,0 +1,36 @@
+; *** REQUIREMENTS ***
+; blkcache
+; stdio
+
+; Writes dirty blocks of the cache back to the underlying device.
+blkcacheFlushCmd:
+	.db	"bcfl", 0, 0, 0
+	call	blkcacheFlush
+	ld	a, 0
+	ret	z
+	ld	a, SHELL_ERR_IO_ERROR
+	ret
+
+; Prints cache hits and misses, each as a 32-bit hex number.
+; Example output: "00001234 00000012"
+blkcacheStatsCmd:
+	.db	"bcst", 0, 0, 0
+	ld	hl, BLKCACHE_HITS
+	call	.print
+	ld	a, ' '
+	call	stdioPutC
+	ld	hl, BLKCACHE_MISSES
+	call	.print
+	call	printcrlf
+	xor	a
+	ret
+.print:
+	; counters are little endian, print from the MSB
+	inc	hl \ inc hl \ inc hl
+	ld	b, 4
+.loop:
+	ld	a, (hl)
+	call	printHex
+	dec	hl
+	djnz	.loop
+	ret
@@ -13,7 +13,7 @@
 ; * New allocations try to find spots to fit in, but go at the end if no spot is
 ;   large enough.
 ; * Block size is 0x100, max block count per file is 8bit, that means that max
-;   file size: 64k - metadata overhead.
+;   file size: 64k - metadata overhead. Large files (see below) lift that limit.
 ;
 ; *** Selecting a "source" blockdev
 ;
@@ -37,10 +37,46 @@
 ; 1b: Allocated block count, including the first one. Except for the "ending"
 ;     block, this is never zero.
 ; 2b: Size of file in bytes (actually written). Little endian.
-; 26b: file name, null terminated. last byte must be null.
+; 25b: file name, null terminated. Names are thus at most 24 bytes long.
+; 1b: flags. See below.
 ;
 ; That gives us 32 bytes of metadata for first first block, leaving a maximum
-; file size of 0xffe0.
+; file size of 0xfee0 (0xff blocks).
+;
+; *** Large files
+;
+; When the FS_FLAG_LARGE flag is set, the last 2 bytes of the name field hold
+; the high parts of block count and size:
+;
+; 0x1d: Allocated block count, bits 15:8
+; 0x1e: Size of file in bytes, bits 23:16
+;
+; This makes files up to 0xffff blocks big, but their name can only be 22 bytes
+; long (followed by a null char at 0x1c). Positions and sizes of fsGetC, fsPutC
+; and fsSetSize are 24-bit, in DE/HL, like in blockdev.asm.
+;
+; Other files are the same as before the flag existed. Large files are created
+; by "cfspack" and can't be compressed. fsAlloc doesn't create them.
+;
+; *** Compressed files
+;
+; When the FS_FLAG_LZ flag is set, the file is compressed and read-only. Its
+; size in metadata is its uncompressed size. Its content is split in chunks of
+; 0x100 uncompressed bytes, each chunk being compressed independently. Its data
+; begins with an index of 2b offsets, one per chunk, pointing to the chunk's
+; compressed stream (relative to the end of metadata). Streams follow.
+;
+; A stream is a series of tokens:
+;
+; 0x00-0x7f: N+1 literal bytes follow.
+; 0x80-0xff: copy (N & 0x7f)+3 bytes from D+1 bytes back in the chunk, D being
+;            the next byte.
+;
+; fsGetC decompresses the chunk containing the requested position in
+; FS_LZBUF and keeps it there, so sequential reads only decompress each chunk
+; once and seeking only costs the decompression of a single chunk.
+;
+; Those files are created by "cfspack -c".
 ;
 ; *** Last block of the chain
 ;
@@ -84,10 +120,18 @@
 .equ	FS_META_ALLOC_OFFSET	3
 .equ	FS_META_FSIZE_OFFSET	4
 .equ	FS_META_FNAME_OFFSET	6
+; Large files only
+.equ	FS_META_ALLOCH_OFFSET	0x1d
+.equ	FS_META_FSIZEH_OFFSET	0x1e
+.equ	FS_META_FLAGS_OFFSET	0x1f
+; Flags
+.equ	FS_FLAG_LZ		0x01
+.equ	FS_FLAG_LARGE		0x02
 ; Size in bytes of a FS handle:
 ; * 4 bytes for starting offset of the FS block
-; * 2 bytes for file size
-.equ	FS_HANDLE_SIZE		6
+; * 3 bytes for file size
+; * 1 byte for flags
+.equ	FS_HANDLE_SIZE		8
 .equ	FS_ERR_NO_FS		0x5
 .equ	FS_ERR_NOT_FOUND	0x6
 
@@ -103,7 +147,12 @@
 ; to. We read this data in memory to avoid constant seek+read operations.
 .equ	FS_META		FS_START+4
 .equ	FS_HANDLES	FS_META+FS_METASIZE
-.equ	FS_RAMEND	FS_HANDLES+FS_HANDLE_COUNT*FS_HANDLE_SIZE
+; Handle (address) and chunk of the compressed file that is currently
+; decompressed in FS_LZBUF. Handle is 0 when there's none.
+.equ	FS_LZHDL	FS_HANDLES+FS_HANDLE_COUNT*FS_HANDLE_SIZE
+.equ	FS_LZCHUNK	FS_LZHDL+2
+.equ	FS_LZBUF	FS_LZCHUNK+1
+.equ	FS_RAMEND	FS_LZBUF+FS_BLOCKSIZE
 
 ; *** DATA ***
 P_FS_MAGIC:
@@ -114,7 +163,7 @@ P_FS_MAGIC:
 fsInit:
 	xor	a
 	ld	hl, FS_BLK
-	ld	b, FS_RAMEND-FS_BLK
+	ld	b, FS_LZBUF-FS_BLK
 	call	fill
 	ret
 
@@ -144,16 +193,28 @@ fsBegin:
 fsNext:
 	push	bc
 	push	hl
-	ld	a, (FS_META+FS_META_ALLOC_OFFSET)
-	or	a		; cp 0
+	call	fsAllocCount
+	ld	a, h
+	or	l
 	jr	z, .error	; if our block allocates 0 blocks, this is the
 				; end of the line.
-	ld	b, a		; we will seek A times
-.loop:
+	ld	b, h		; B is the number of 0x10000 bytes to skip
+	ld	h, l		; HL = (count & 0xff) * FS_BLOCKSIZE
+	ld	l, 0
+	ld	a, BLOCKDEV_SEEK_FORWARD
+	call	fsblkSeek
+	ld	a, b
+	or	a
+	jr	z, .seeked
 	ld	a, BLOCKDEV_SEEK_FORWARD
-	ld	hl, FS_BLOCKSIZE
+.loop:
+	; Seeks are 16-bit, 0x10000 is two 0x8000 seeks.
+	ld	hl, 0x8000
+	call	fsblkSeek
+	ld	hl, 0x8000
 	call	fsblkSeek
 	djnz	.loop
+.seeked:
 	call	fsReadMeta
 	jr	nz, .createChainEnd
 	call	fsIsValid
@@ -258,7 +319,11 @@ fsAlloc:
 	call	fsIsDeleted
 	jr	nz, .loop1	; not deleted? loop
 	; This is a deleted block. Maybe it fits...
-	ld	a, (FS_META+FS_META_ALLOC_OFFSET)
+	call	fsAllocCount
+	ld	a, h
+	or	a
+	jr	nz, .loop1	; way too big
+	ld	a, l
 	cp	c		; Same as asked size?
 	jr	z, .found	; yes? great!
 	; TODO: handle case where C < A (block splitting)
@@ -275,8 +340,10 @@ fsAlloc:
 	ld	(FS_META+FS_META_ALLOC_OFFSET), a
 	pop	hl		; now we want our HL arg
 	; TODO: stop after null char. we're filling meta with garbage here.
+	; The last 2 bytes of the name field are a null char, for names that
+	; are too long, and flags. We leave them to zero.
 	ld	de, FS_META+FS_META_FNAME_OFFSET
-	ld	bc, FS_MAX_NAME_SIZE
+	ld	bc, FS_MAX_NAME_SIZE-2
 	ldir
 	; Good, FS_META ready.
 	; Ok, now we can write our metadata
@@ -328,6 +395,18 @@ fsIsDeleted:
 	cp	0	; Z flag is our answer
 	ret
 
+; Returns the number of blocks allocated to current block in HL.
+fsAllocCount:
+	ld	a, (FS_META+FS_META_ALLOC_OFFSET)
+	ld	l, a
+	ld	h, 0
+	ld	a, (FS_META+FS_META_FLAGS_OFFSET)
+	and	FS_FLAG_LARGE
+	ret	z
+	ld	a, (FS_META+FS_META_ALLOCH_OFFSET)
+	ld	h, a
+	ret
+
 ; *** blkdev methods ***
 ; When "mounting" a FS, we copy the current blkdev's routine privately so that
 ; we can still access the FS even if blkdev selection changes. These routines
@@ -394,40 +473,61 @@ fsOpen:
 	ld      hl, (FS_META+FS_META_FSIZE_OFFSET)
 	ld	(ix+4), l
 	ld	(ix+5), h
+	ld	a, (FS_META+FS_META_FLAGS_OFFSET)
+	ld	(ix+7), a
+	and	FS_FLAG_LARGE
+	jr	z, .small	; A is zero
+	ld	a, (FS_META+FS_META_FSIZEH_OFFSET)
+.small:
+	ld	(ix+6), a
+	; The handle we're reusing might have a chunk in FS_LZBUF.
+	ld	hl, 0
+	ld	(FS_LZHDL), hl
 	pop	af
 	pop	hl
 	ret
 
-; Place FS blockdev at proper position for file handle in (IX) at position HL.
+; Place FS blockdev at proper position for file handle in (IX) at position
+; DE/HL.
 fsPlaceH:
 	push	af
+	push	bc
 	push	de
 	push	hl
-	; Move fsdev to beginning of block
-	ld	e, (ix)
-	ld	d, (ix+1)
-	ld	l, (ix+2)
-	ld	h, (ix+3)
+	; DE/HL = beginning of block + FS_METASIZE + DE/HL
+	ld	c, (ix+2)
+	ld	b, (ix+3)
+	add	hl, bc
+	ex	de, hl
+	ld	c, (ix)
+	ld	b, (ix+1)
+	adc	hl, bc
+	ex	de, hl
+	ld	bc, FS_METASIZE
+	add	hl, bc
+	jr	nc, .seek
+	inc	de
+.seek:
 	ld	a, BLOCKDEV_SEEK_ABSOLUTE
 	call	fsblkSeek
-
-	; skip metadata
-	ld	a, BLOCKDEV_SEEK_FORWARD
-	ld	hl, FS_METASIZE
-	call	fsblkSeek
-
 	pop	hl
 	pop	de
-
-	; go to specified pos
-	ld	a, BLOCKDEV_SEEK_FORWARD
-	call	fsblkSeek
+	pop	bc
 	pop	af
 	ret
 
-; Sets Z according to whether HL is within bounds for file handle at (IX), that
-; is, if it is smaller than file size.
+; Sets Z according to whether DE/HL is within bounds for file handle at (IX),
+; that is, if it is smaller than file size.
 fsWithinBounds:
+	push	bc
+	ld	b, a		; preserve A
+	ld	a, d
+	or	a
+	jr	nz, .outOfBounds	; sizes are 24-bit
+	ld	a, e
+	cp	(ix+6)
+	jr	c, .withinBounds	; E < size's MSB
+	jr	nz, .outOfBounds	; E > size's MSB
 	push	de
 	; file size
 	ld	e, (ix+4)
@@ -435,15 +535,23 @@ fsWithinBounds:
 	call	cpHLDE
 	pop	de
 	jr	nc, .outOfBounds	; HL >= DE
+.withinBounds:
 	cp	a			; ensure Z
-	ret
+	jr	.end
 .outOfBounds:
-	jp	unsetZ			; returns
+	call	unsetZ
+.end:
+	ld	a, b
+	pop	bc
+	ret
 
-; Set size of file handle (IX) to value in HL.
+; Set size of file handle (IX) to value in DE/HL. E is ignored, unless the
+; file is a large one.
 ; This writes directly in handle's metadata.
 fsSetSize:
+	push	de
 	push	hl		; --> lvl 1
+	ld	de, 0
 	ld	hl, 0
 	call	fsPlaceH	; fs blkdev is now at beginning of content
 	; we need the blkdev to be on filesize's offset
@@ -451,10 +559,9 @@ fsSetSize:
 	ld	a, BLOCKDEV_SEEK_BACKWARD
 	call	fsblkSeek
 	pop	hl		; <-- lvl 1
-	; blkdev is at the right spot, HL is back to its original value, let's
-	; write it both in the metadata block and in its file handle's cache.
-	push	hl		; --> lvl 1
-	; now let's write our new filesize both in blkdev and in file handle's
+	pop	de
+	; blkdev is at the right spot, DE/HL is back to its original value,
+	; let's write it both in the metadata block and in its file handle's
 	; cache.
 	ld	a, l
 	ld	(ix+4), a
@@ -462,11 +569,21 @@ fsSetSize:
 	ld	a, h
 	ld	(ix+5), a
 	call	fsblkPutC
-	pop	hl		; <-- lvl 1
+	ld	a, (ix+7)
+	and	FS_FLAG_LARGE
+	ret	z		; Z is set
+	push	hl
+	ld	hl, FS_META_FSIZEH_OFFSET-FS_META_FNAME_OFFSET
+	ld	a, BLOCKDEV_SEEK_FORWARD
+	call	fsblkSeek
+	pop	hl
+	ld	a, e
+	ld	(ix+6), a
+	call	fsblkPutC
 	xor	a	; ensure Z
 	ret
 
-; Read a byte in handle at (IX) at position HL and put it into A.
+; Read a byte in handle at (IX) at position DE/HL and put it into A.
 ; Z is set on success, unset if handle is at the end of the file.
 fsGetC:
 	call	fsWithinBounds
@@ -476,26 +593,151 @@ fsGetC:
 	xor	a
 	jp	unsetZ		; returns
 .proceed:
-	push	hl
+	ld	a, (ix+7)
+	and	FS_FLAG_LZ
+	jr	nz, .lz
 	call	fsPlaceH
 	call	fsblkGetC
 	cp	a		; ensure Z
+	ret
+.lz:
+	call	fsLZLoad
+	ret	nz
+	push	hl
+	ld	a, l
+	ld	hl, FS_LZBUF
+	call	addHL
+	ld	a, (hl)
 	pop	hl
+	cp	a		; ensure Z
 	ret
 
-; Write byte A in handle (IX) at position HL.
-; Z is set on success, unset if handle is at the end of the file.
+; Decompress chunk H of compressed file handle (IX) in FS_LZBUF, unless it's
+; already there.
+; Z is set on success, unset if the data is corrupted or can't be read.
+fsLZLoad:
+	push	bc
+	push	de
+	push	hl		; --> lvl 1
+	ld	a, (FS_LZCHUNK)
+	cp	h
+	jr	nz, .load
+	push	ix \ pop de
+	ld	hl, (FS_LZHDL)
+	call	cpHLDE
+	jr	z, .end		; already there
+.load:
+	; If we fail midway, FS_LZBUF is garbage.
+	ld	hl, 0
+	ld	(FS_LZHDL), hl
+	; Read chunk offset in index
+	pop	hl \ push hl	; H is our chunk
+	ld	l, h
+	ld	h, 0
+	add	hl, hl
+	ld	de, 0
+	call	fsPlaceH
+	call	fsblkGetC
+	jr	nz, .end
+	ld	e, a
+	call	fsblkGetC
+	jr	nz, .end
+	ld	d, a
+	ex	de, hl
+	ld	de, 0
+	call	fsPlaceH
+	; B is the number of bytes to decompress. 0 means 0x100. Because we're
+	; within bounds, chunk is either a full one (H < file size's MSB) or the
+	; last one.
+	pop	hl \ push hl
+	ld	de, FS_LZBUF
+	ld	b, 0
+	ld	a, (ix+5)
+	cp	h
+	jr	nz, .loop
+	ld	b, (ix+4)
+.loop:
+	call	fsblkGetC	; token
+	jr	nz, .end
+	cp	0x80
+	jr	nc, .match
+	; literal run of A+1 bytes
+	inc	a
+	ld	c, a
+.lit:
+	call	fsblkGetC
+	jr	nz, .end
+	ld	(de), a
+	inc	de
+	dec	b
+	jr	z, .done
+	dec	c
+	jr	nz, .lit
+	jr	.loop
+.match:
+	and	0x7f
+	add	a, 3
+	ld	c, a
+	call	fsblkGetC	; distance-1
+	jr	nz, .end
+	; HL = DE - (A+1)
+	cpl
+	ld	l, a
+	ld	h, 0xff
+	add	hl, de
+.copy:
+	ld	a, (hl)
+	ld	(de), a
+	inc	hl
+	inc	de
+	dec	b
+	jr	z, .done
+	dec	c
+	jr	nz, .copy
+	jr	.loop
+.done:
+	pop	hl \ push hl
+	ld	a, h
+	ld	(FS_LZCHUNK), a
+	ld	(FS_LZHDL), ix
+	cp	a		; ensure Z
+.end:
+	pop	hl		; <-- lvl 1
+	pop	de
+	pop	bc
+	ret
+
+; Write byte A in handle (IX) at position DE/HL.
+; Z is set on success, unset if handle is at the end of the file or if the file
+; is compressed (read-only).
 ; TODO: detect end of block alloc
 fsPutC:
-	push	hl
+	push	af
+	ld	a, (ix+7)
+	and	FS_FLAG_LZ
+	jr	z, .proceed
+	pop	af
+	jp	unsetZ		; returns
+.proceed:
+	pop	af
 	call	fsPlaceH
 	call	fsblkPutC
-	pop	hl
-	; if HL is out of bounds, increase bounds
+	; if DE/HL is out of bounds, increase bounds
 	call	fsWithinBounds
 	ret	z
-	inc	hl		; our filesize is now HL+1
-	jp	fsSetSize
+	push	de
+	push	hl
+	; our filesize is now DE/HL+1
+	inc	hl
+	ld	a, h
+	or	l
+	jr	nz, .setSize
+	inc	de
+.setSize:
+	call	fsSetSize
+	pop	hl
+	pop	de
+	ret
 
 ; Mount the fs subsystem upon the currently selected blockdev at current offset.
 ; Verify is block is valid and error out if its not, mounting nothing.
@@ -510,6 +752,9 @@ fsOn:
 	ld	de, FS_BLK
 	ld	bc, BLOCKDEV_SIZE
 	ldir			; copy!
+	; Whatever is in FS_LZBUF comes from another FS.
+	ld	hl, 0
+	ld	(FS_LZHDL), hl
 	call	fsblkTell
 	ld	(FS_START), de
 	ld	(FS_START+2), hl
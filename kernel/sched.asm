@@ -0,0 +1,232 @@
+; sched
+;
+; Cooperative task scheduler.
+;
+; Tasks are routines running alongside the main program, each on its own stack.
+; They're cooperative: a task runs until it calls schedYield or schedSleep (or
+; returns, which ends it) and only then does another task get to run. Nothing
+; is ever switched in the middle of a routine, so tasks can call kernel routines
+; without any locking as long as they don't yield while a shared state (a
+; blockdev buffer, for example) is half-updated.
+;
+; Blocking I/O is where yielding pays off: a routine polling a device that has
+; nothing for it (the shell waiting for input, an SD card busy writing) calls
+; schedYield in its waiting loop and other tasks run in the meantime. The stdio
+; GetC routine is a good place for it when it has nothing to return: the shell
+; and apps reading lines with stdioReadLine all poll it. The shell's loop hook
+; is only called by the shell, so a yield there stops while an app runs. For
+; example, a task can write dirty blkcache or sdc buffers back (see
+; blkcacheFlush and sdcFlush) while we wait for input instead of having the next
+; command do it.
+;
+; Time is counted in ticks of a periodic timer. schedInt is the timer's
+; interrupt handler: glue code jumps to it from 0x38 (IM 1). It only counts
+; ticks, it doesn't switch tasks. A task sleeping with schedSleep runs again at
+; the first yield after its delay has elapsed. If no task is ready, schedYield
+; waits for one to be, so interrupts have to be enabled when a task sleeps.
+;
+; The task calling schedInit becomes task 0. It keeps the stack it has. Other
+; tasks are started with schedSpawn and get their stack in SCHED_STACKS. A task
+; stack has to be big enough for what the task calls, plus 12 bytes for the
+; registers saved when it yields and 4 bytes for the interrupt handler.
+
+; *** DEFINES ***
+; SCHED_COUNT: Number of tasks, including task 0. At least 2.
+; SCHED_STACKSIZE: Size of the stack of each task other than task 0.
+
+; *** CONSTS ***
+; Entry structure:
+; 2b: saved SP. 0 means that the entry is free.
+; 2b: tick at which the task is ready to run again.
+.equ	SCHED_ENTRY_SIZE	4
+
+; *** VARIABLES ***
+; Number of ticks since schedInit, wrapping around.
+.equ	SCHED_TICKS		SCHED_RAMSTART
+; Index of the running task.
+.equ	SCHED_CUR		SCHED_TICKS+2
+.equ	SCHED_TASKS		SCHED_CUR+1
+.equ	SCHED_STACKS		SCHED_TASKS+SCHED_COUNT*SCHED_ENTRY_SIZE
+; Task 0 has no stack there
+.equ	SCHED_RAMEND		SCHED_STACKS+SCHED_COUNT*SCHED_STACKSIZE-SCHED_STACKSIZE
+
+; *** CODE ***
+
+; Make the caller task 0 and forget about all other tasks.
+schedInit:
+	xor	a
+	ld	hl, SCHED_TICKS
+	ld	b, SCHED_STACKS-SCHED_TICKS
+	call	fill
+	; Task 0 is running. Its SP only has to be non-zero until it's saved.
+	ld	hl, SCHED_TASKS
+	ld	(hl), 1
+	ret
+
+; Timer interrupt handler. Jump to it from 0x38.
+schedInt:
+	push	hl
+	ld	hl, (SCHED_TICKS)
+	inc	hl
+	ld	(SCHED_TICKS), hl
+	pop	hl
+	ei
+	reti
+
+; Start a task that runs routine HL on its own stack. It runs when the current
+; task yields. When the routine returns, the task ends and its slot is freed.
+; Sets Z and A to the new task's ID on success. Unsets Z if all slots are used.
+schedSpawn:
+	push	bc
+	push	de
+	push	hl
+	push	ix
+	ld	ix, SCHED_TASKS+SCHED_ENTRY_SIZE	; task 0 is never free
+	ld	de, SCHED_STACKS+SCHED_STACKSIZE	; end of task 1's stack
+	ld	b, 1
+.loop:
+	ld	a, (ix)
+	or	(ix+1)
+	jr	z, .found
+	push	bc
+	ld	bc, SCHED_STACKSIZE
+	ex	de, hl
+	add	hl, bc
+	ex	de, hl
+	ld	bc, SCHED_ENTRY_SIZE
+	add	ix, bc
+	pop	bc
+	inc	b
+	ld	a, b
+	cp	SCHED_COUNT
+	jr	nz, .loop
+	; no free slot
+	call	unsetZ
+	jr	.end
+.found:
+	push	bc		; B is the task ID
+	; Build the stack _schedNext expects: registers, then the routine as a
+	; return address, then _schedExit for the routine to return to.
+	ex	de, hl		; HL: end of stack, DE: routine
+	ld	bc, _schedExit
+	dec	hl
+	ld	(hl), b
+	dec	hl
+	ld	(hl), c
+	dec	hl
+	ld	(hl), d
+	dec	hl
+	ld	(hl), e
+	ld	de, 0xfff4	; -12. Saved register values don't matter.
+	add	hl, de
+	ld	(ix), l
+	ld	(ix+1), h
+	ld	hl, (SCHED_TICKS)
+	ld	(ix+2), l
+	ld	(ix+3), h
+	pop	bc
+	ld	a, b		; task ID
+	cp	a		; ensure Z
+.end:
+	pop	ix
+	pop	hl
+	pop	de
+	pop	bc
+	ret
+
+; Let other tasks run. Returns when it's our turn again. All registers are
+; preserved.
+schedYield:
+	push	hl
+	ld	hl, 0
+	call	schedSleep
+	pop	hl
+	ret
+
+; Let other tasks run until HL more ticks have happened. HL can't be more than
+; 0x7fff. All registers are preserved.
+schedSleep:
+	push	af
+	push	bc
+	push	de
+	push	hl
+	push	ix
+	push	iy
+	call	_schedCur
+	ex	de, hl
+	ld	hl, (SCHED_TICKS)
+	add	hl, de
+	ld	(ix+2), l
+	ld	(ix+3), h
+	ld	hl, 0
+	add	hl, sp
+	ld	(ix), l
+	ld	(ix+1), h
+	; continue to _schedNext
+
+; Switch to the next task that is ready to run, round-robin, and return to
+; where it yielded. The current task is a candidate, after all others.
+_schedNext:
+	ld	a, (SCHED_CUR)
+	ld	b, a
+.loop:
+	inc	b
+	ld	a, b
+	cp	SCHED_COUNT
+	jr	nz, .check
+	ld	b, 0
+.check:
+	ld	a, b
+	call	_schedEntry
+	ld	l, (ix)
+	ld	h, (ix+1)
+	ld	a, h
+	or	l
+	jr	z, .loop	; free
+	; The task is ready if its wake-up tick isn't in the future, that is, if
+	; TICKS - wake-up is positive.
+	push	hl
+	ld	hl, (SCHED_TICKS)
+	ld	e, (ix+2)
+	ld	d, (ix+3)
+	or	a		; reset carry
+	sbc	hl, de
+	bit	7, h
+	pop	hl
+	jr	nz, .loop	; still sleeping
+	ld	a, b
+	ld	(SCHED_CUR), a
+	ld	sp, hl
+	pop	iy
+	pop	ix
+	pop	hl
+	pop	de
+	pop	bc
+	pop	af
+	ret
+
+; Where task routines return: free the slot and switch to another task.
+_schedExit:
+	call	_schedCur
+	xor	a
+	ld	(ix), a
+	ld	(ix+1), a
+	jr	_schedNext
+
+; Make IX point to the entry of the running task.
+_schedCur:
+	ld	a, (SCHED_CUR)
+	; continue to _schedEntry
+
+; Make IX point to the entry of task A.
+_schedEntry:
+	push	de
+	ld	ix, SCHED_TASKS
+	ld	e, a
+	ld	d, 0
+	add	ix, de
+	add	ix, de
+	add	ix, de
+	add	ix, de
+	pop	de
+	ret
@@ -621,6 +621,22 @@ sdcCRC:
 	pop	af
 	ret
 
+; Write both buffers to the SD card if they're dirty. A background task can call
+; this (see sched.asm) so that the card is written to while we wait for input.
+; Returns Z on success, not-Z on error (with the error code from sdcWriteBlk)
+sdcFlush:
+	push	hl
+	ld	hl, SDC_BUFSEC1
+	ld	(SDC_BUFPTR), hl
+	call	sdcWriteBlk
+	jr	nz, .end
+	ld	hl, SDC_BUFSEC2
+	ld	(SDC_BUFPTR), hl
+	call	sdcWriteBlk
+.end:
+	pop	hl
+	ret
+
 ; *** shell cmds ***
 
 sdcInitializeCmd:
@@ -679,13 +695,7 @@ sdcInitializeCmd:
 ; Flush the current SDC buffer if dirty
 sdcFlushCmd:
 	.db	"sdcf", 0, 0, 0
-	ld	hl, SDC_BUFSEC1
-	ld	(SDC_BUFPTR), hl
-	call	sdcWriteBlk
-	ret	nz
-	ld	hl, SDC_BUFSEC2
-	ld	(SDC_BUFPTR), hl
-	jp	sdcWriteBlk		; returns
+	jp	sdcFlush
 
 ; *** blkdev routines ***
 
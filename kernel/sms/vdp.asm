@@ -5,25 +5,30 @@
 ; char on screen, advancing the cursor by one. When reaching the end of the
 ; line (33rd char), wrap to the next.
 ;
-; In the future, there's going to be a scrolling mechanism when we reach the
-; bottom of the screen, but for now, when the end of the screen is reached, we
-; wrap up to the top.
-;
-; When reaching a new line, we clear that line and the next to help readability.
+; The name table has 28 lines, but only 24 of them are on screen. When the
+; cursor goes past the bottom of the screen, we scroll one line down with the
+; vertical scroll register, which brings the next name table line (wrapping
+; after the 28th) at the bottom of the screen. The only thing we have to write
+; to VRAM is the clearing of that new line.
 ;
 ; *** Consts ***
 ;
 .equ	VDP_CTLPORT	0xbf
 .equ	VDP_DATAPORT	0xbe
+; Lines on screen and in the name table
+.equ	VDP_SCREENLINES	24
+.equ	VDP_NTLINES	28
 
 ; *** Variables ***
 ;
 ; Row of cursor
 .equ	VDP_ROW		VDP_RAMSTART
-; Line of cursor
+; Line of cursor, in the name table
 .equ	VDP_LINE	VDP_ROW+1
+; Name table line that is at the top of the screen
+.equ	VDP_TOPLINE	VDP_LINE+1
 ; Returns, in A, the currently selected char in a "pad char selection" scheme.
-.equ	VDP_CHRSELHOOK	VDP_LINE+1
+.equ	VDP_CHRSELHOOK	VDP_TOPLINE+1
 .equ	VDP_LASTSEL	VDP_CHRSELHOOK+2
 .equ	VDP_RAMEND	VDP_LASTSEL+1
 
@@ -33,6 +38,7 @@ vdpInit:
 	xor	a
 	ld	(VDP_ROW), a
 	ld	(VDP_LINE), a
+	ld	(VDP_TOPLINE), a
 	ld	(VDP_LASTSEL), a
 	ld	hl, noop
 	ld	(VDP_CHRSELHOOK), hl
@@ -176,25 +182,46 @@ vdpLF:
 	; a CR, which already cleared the pos. If we cleared it now, we would
 	; clear the first char of the line.
 	push	af
+	push	hl
 	ld	a, (VDP_LINE)
 	call	.incA
+	ld	(VDP_LINE), a
 	call	vdpClrLine
-	; Also clear the line after this one
-	push	af		; --> lvl 1
+	; Are we past the bottom of the screen?
+	ld	hl, VDP_TOPLINE
+	sub	(hl)
+	jr	nc, .nowrap
+	add	a, VDP_NTLINES
+.nowrap:
+	cp	VDP_SCREENLINES
+	jr	nz, .end
+	; We are, scroll down one line.
+	ld	a, (hl)
 	call	.incA
-	call	vdpClrLine
-	pop	af		; <-- lvl 1
-	ld	(VDP_LINE), a
+	ld	(hl), a
+	call	vdpSetScroll
+.end:
+	pop	hl
 	pop	af
 	ret
 .incA:
 	inc	a
-	cp	24
+	cp	VDP_NTLINES
 	ret	nz	; no rollover
-	; bottom reached, roll over to top of screen
+	; end of name table reached, roll over to its beginning
 	xor	a
 	ret
 
+; Set vertical scroll so that name table line A is at the top of the screen.
+vdpSetScroll:
+	push	af
+	rlca \ rlca \ rlca	; * 8, the height of a line in pixels
+	out	(VDP_CTLPORT), a
+	ld	a, 0x89		; register 9
+	out	(VDP_CTLPORT), a
+	pop	af
+	ret
+
 vdpBS:
 	call	vdpClrPos
 	push	af
@@ -206,18 +233,24 @@ vdpBS:
 	pop	af
 	ret
 .lineup:
-	; end of line
+	; we have to go one line up, unless we're at the top of the screen.
+	ld	a, (VDP_TOPLINE)
+	push	hl
+	ld	hl, VDP_LINE
+	cp	(hl)
+	pop	hl
+	jr	z, .end
 	ld	a, 31
 	ld	(VDP_ROW), a
-	; we have to go one line up
 	ld	a, (VDP_LINE)
 	or	a
-	jr	z, .nowrap
-	; We have to wrap to the bottom of the screen
-	ld	a, 24
+	jr	nz, .nowrap
+	; We have to wrap to the end of the name table
+	ld	a, VDP_NTLINES
 .nowrap:
 	dec	a
 	ld	(VDP_LINE), a
+.end:
 	pop	af
 	ret
 
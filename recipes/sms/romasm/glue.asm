@@ -142,22 +142,22 @@ edCmd:
 	push	hl \ pop ix
 	ld	l, (ix)
 	ld	h, (ix+1)
-	jp	0x1900
+	jp	0x1b00
 
 zasmCmd:
 	.db	"zasm", 0b1001, 0, 0
 	push	hl \ pop ix
 	ld	l, (ix)
 	ld	h, (ix+1)
-	jp	0x1d00
+	jp	0x1f00
 
-; last time I checked, PC at this point was 0x183c. Let's give us a nice margin
+; last time I checked, PC at this point was 0x19fb. Let's give us a nice margin
 ; for the start of ed.
-.fill 0x1900-$
+.fill 0x1b00-$
 .bin "ed.bin"
 
-; Last check: 0x1c4e
-.fill 0x1d00-$
+; Last check: 0x1e75
+.fill 0x1f00-$
 .bin "zasm.bin"
 
 .fill 0x7ff0-$
@@ -1,14 +1,24 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <dirent.h>
 #include <string.h>
 #include <fnmatch.h>
 #include <libgen.h>
 #include <sys/stat.h>
+#include "lz.h"
 
 #define BLKSIZE 0x100
 #define HEADERSIZE 0x20
-#define MAX_FN_LEN 25   // 26 - null char
-#define MAX_FILE_SIZE (BLKSIZE * 0x100) - HEADERSIZE
+#define MAX_FN_LEN 24   // 26 - null char - flags
+#define MAX_FILE_SIZE (BLKSIZE * 0xff) - HEADERSIZE
+// Large files have a 16-bit block count and a 24-bit size, whose high bytes
+// take the end of the name field.
+#define MAX_LARGE_FN_LEN 22
+#define MAX_LARGE_FILE_SIZE (BLKSIZE * 0xffff) - HEADERSIZE
+#define FLAG_LZ 0x01
+#define FLAG_LARGE 0x02
+
+static int compress = 0;
 
 int is_regular_file(char *path)
 {
@@ -22,46 +32,81 @@ int spitblock(char *fullpath, char *fn)
     FILE *fp = fopen(fullpath, "r");
     fseek(fp, 0, SEEK_END);
     long fsize = ftell(fp);
-    if (fsize > MAX_FILE_SIZE) {
+    if (fsize > MAX_LARGE_FILE_SIZE) {
         fclose(fp);
         fprintf(stderr, "File too big: %s %ld\n", fullpath, fsize);
         return 1;
     }
+    // We spit whole blocks, make room for the padding of the last one.
+    unsigned char *buf = calloc(fsize + BLKSIZE, 1);
+    rewind(fp);
+    fread(buf, fsize, 1, fp);
+    fclose(fp);
+    unsigned char *data = buf;
+    long datasize = fsize;
+    unsigned char flags = 0;
+    if (compress && fsize <= LZ_MAX_FILE_SIZE) {
+        static unsigned char lzbuf[LZ_MAX_COMPRESSED(LZ_MAX_FILE_SIZE)];
+        memset(lzbuf, 0, sizeof(lzbuf));
+        long lzsize = lzfile(buf, fsize, lzbuf);
+        // Only keep compressed data if it's worth it.
+        if (lzsize < fsize && lzsize <= MAX_FILE_SIZE) {
+            data = lzbuf;
+            datasize = lzsize;
+            flags |= FLAG_LZ;
+        }
+    }
+    if (strlen(fn) > MAX_FN_LEN) {
+        free(buf);
+        fprintf(stderr, "Filename too long: %s\n", fn);
+        return 1;
+    }
+    if (datasize > MAX_FILE_SIZE) {
+        if (strlen(fn) > MAX_LARGE_FN_LEN) {
+            free(buf);
+            fprintf(stderr, "Filename too long for a large file: %s\n", fn);
+            return 1;
+        }
+        flags |= FLAG_LARGE;
+    }
     /* Compute block count.
      * We always have at least one, which contains 0x100 bytes - 0x20, which is
      * metadata. The rest of the blocks have a steady 0x100.
      */
-    unsigned char blockcount = 1;
-    int fsize2 = fsize - (BLKSIZE - HEADERSIZE);
+    unsigned int blockcount = 1;
+    long fsize2 = datasize - (BLKSIZE - HEADERSIZE);
     if (fsize2 > 0) {
         blockcount += (fsize2 / BLKSIZE);
     }
-    if (blockcount * BLKSIZE < fsize + HEADERSIZE) {
+    if (blockcount * BLKSIZE < datasize + HEADERSIZE) {
         blockcount++;
     }
     putchar('C');
     putchar('F');
     putchar('S');
-    putchar(blockcount);
+    putchar(blockcount & 0xff);
     // file size is little endian
     putchar(fsize & 0xff);
     putchar((fsize >> 8) & 0xff);
     int fnlen = strlen(fn);
-    for (int i=0; i<MAX_FN_LEN; i++) {
+    // Names are followed by at least one null char.
+    int namelen = ((flags & FLAG_LARGE) ? MAX_LARGE_FN_LEN : MAX_FN_LEN) + 1;
+    for (int i=0; i<namelen; i++) {
         if (i < fnlen) {
             putchar(fn[i]);
         } else {
             putchar(0);
         }
     }
-    // And the last FN char which is always null
-    putchar(0);
-    char buf[MAX_FILE_SIZE] = {0};
-    rewind(fp);
-    fread(buf, fsize, 1, fp);
-    fclose(fp);
-    fwrite(buf, (blockcount * BLKSIZE) - HEADERSIZE, 1, stdout);
+    if (flags & FLAG_LARGE) {
+        putchar((blockcount >> 8) & 0xff);
+        putchar((fsize >> 16) & 0xff);
+    }
+    // The last byte of the name field holds flags.
+    putchar(flags);
+    fwrite(data, (blockcount * BLKSIZE) - HEADERSIZE, 1, stdout);
     fflush(stdout);
+    free(buf);
     return 0;
 }
 
@@ -84,8 +129,9 @@ int spitdir(char *path, char *prefix, char *pattern)
             fprintf(stderr, "Only regular file or directories are supported\n");
             return 1;
         }
-        int slen = strlen(ep->d_name);
-        if (prefixlen + slen> MAX_FN_LEN) {
+        // +1 for the "/" after the prefix
+        int slen = strlen(ep->d_name) + (prefixlen > 0 ? 1 : 0);
+        if (prefixlen + slen > MAX_FN_LEN) {
             fprintf(stderr, "Filename too long: %s/%s\n", prefix, ep->d_name);
             return 1;
         }
@@ -93,7 +139,7 @@ int spitdir(char *path, char *prefix, char *pattern)
         strcpy(fullpath, path);
         strcat(fullpath, "/");
         strcat(fullpath, ep->d_name);
-        char newprefix[MAX_FN_LEN];
+        char newprefix[MAX_FN_LEN+1];
         strcpy(newprefix, prefix);
         if (prefixlen > 0) {
             strcat(newprefix, "/");
@@ -123,8 +169,13 @@ int spitdir(char *path, char *prefix, char *pattern)
 
 int main(int argc, char *argv[])
 {
+    if ((argc > 1) && (strcmp(argv[1], "-c") == 0)) {
+        compress = 1;
+        argc--;
+        argv++;
+    }
     if ((argc > 3) || (argc < 2)) {
-        fprintf(stderr, "Usage: cfspack /path/to/dir [pattern] \n");
+        fprintf(stderr, "Usage: cfspack [-c] /path/to/dir [pattern] \n");
         return 1;
     }
     char *srcpath = argv[1];
@@ -4,15 +4,69 @@
 #include <string.h>
 #include <sys/stat.h>
 
+#include "lz.h"
+
 #define BLKSIZE 0x100
 #define HEADERSIZE 0x20
 #define MAX_FN_LEN 25   // 26 - null char
+#define MAX_LARGE_FN_LEN 22
+#define FLAG_LZ 0x01
+#define FLAG_LARGE 0x02
+
+/* Decompresses a file compressed by cfspack -c. src is the data following
+ * metadata and fsize is the uncompressed size. See lzfile() in lz.c.
+ */
+bool unlz(uint8_t *src, int srclen, int fsize, FILE *fp)
+{
+    uint8_t chunk[BLKSIZE];
+    int chunkcount = (fsize + BLKSIZE - 1) / BLKSIZE;
+    for (int i=0; i<chunkcount; i++) {
+        int clen = fsize - i*BLKSIZE;
+        if (clen > BLKSIZE) {
+            clen = BLKSIZE;
+        }
+        if (i*2+1 >= srclen) {
+            return false;
+        }
+        int s = src[i*2] | (src[i*2+1] << 8);
+        int o = 0;
+        while (o < clen) {
+            if (s >= srclen) {
+                return false;
+            }
+            uint8_t t = src[s++];
+            if (t < 0x80) {
+                for (int j=0; j<=t && o<clen; j++) {
+                    if (s >= srclen) {
+                        return false;
+                    }
+                    chunk[o++] = src[s++];
+                }
+            } else {
+                if (s >= srclen) {
+                    return false;
+                }
+                int dist = src[s++] + 1;
+                if (dist > o) {
+                    return false;
+                }
+                for (int j=0; j<(t & 0x7f)+3 && o<clen; j++) {
+                    chunk[o] = chunk[o-dist];
+                    o++;
+                }
+            }
+        }
+        fwrite(chunk, clen, 1, fp);
+    }
+    return true;
+}
 
 bool ensuredir(char *path)
 {
     char *s = path;
     while (*s != '\0') {
-        if (*s == '/') {
+        // Skip the root of absolute paths
+        if ((*s == '/') && (s != path)) {
             *s = '\0';
             struct stat path_stat;
             if (stat(path, &path_stat) != 0) {
@@ -37,16 +91,25 @@ bool unpackblk(char *dstpath)
         return false;
     }
     int c = getchar();
-    uint8_t blkcnt = c;
-    if (blkcnt == 0) {
-        return false;
-    }
+    uint16_t blkcnt = c & 0xff;
     c = getchar();
-    uint16_t fsize = c & 0xff;
+    uint32_t fsize = c & 0xff;
     c = getchar();
     fsize |= (c & 0xff) << 8;
 
-    if (fgets(buf, MAX_FN_LEN+1+1, stdin) == NULL) {
+    if (fread(buf, MAX_FN_LEN+1, 1, stdin) != 1) {
+        return false;
+    }
+    // The last byte of the name field holds flags.
+    uint8_t flags = buf[MAX_FN_LEN];
+    buf[MAX_FN_LEN] = '\0';
+    if (flags & FLAG_LARGE) {
+        // High bytes of block count and size end the name field.
+        blkcnt |= (buf[MAX_LARGE_FN_LEN+1] & 0xff) << 8;
+        fsize |= (buf[MAX_LARGE_FN_LEN+2] & 0xff) << 16;
+        buf[MAX_LARGE_FN_LEN+1] = '\0';
+    }
+    if (blkcnt == 0) {
         return false;
     }
     char fullpath[0x1000];
@@ -56,12 +119,35 @@ bool unpackblk(char *dstpath)
     if (!ensuredir(fullpath)) {
         return false;
     }
-    int blksize = (BLKSIZE-HEADERSIZE)+(BLKSIZE*(blkcnt-1));
-    int skipcount = blksize - fsize;
+    long blksize = (BLKSIZE-HEADERSIZE)+(BLKSIZE*(blkcnt-1));
+    // cfspack never writes more than that for compressed files. The header
+    // can't be trusted beyond it.
+    static uint8_t data[LZ_MAX_COMPRESSED(LZ_MAX_FILE_SIZE)+BLKSIZE];
+    if (flags & FLAG_LZ) {
+        if ((fsize > LZ_MAX_FILE_SIZE) || (blksize > (long)sizeof(data))) {
+            return false;
+        }
+    } else if (fsize > blksize) {
+        return false;
+    }
     FILE *fp = fopen(fullpath, "w");
+    if (fp == NULL) {
+        return false;
+    }
+    if (flags & FLAG_LZ) {
+        if (fread(data, blksize, 1, stdin) != 1) {
+            fclose(fp);
+            return false;
+        }
+        bool res = unlz(data, blksize, fsize, fp);
+        fclose(fp);
+        return res;
+    }
+    long skipcount = blksize - fsize;
     while (fsize) {
         c = getchar();
         if (c == EOF) {
+            fclose(fp);
             return false;
         }
         fputc(c, fp);
@@ -0,0 +1,73 @@
+#include "lz.h"
+
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 0x82
+#define LZ_MAX_LITERALS 0x80
+
+/* Compresses a chunk of len bytes (len <= LZ_CHUNKSIZE) from src into dst and
+ * returns compressed length.
+ *
+ * Each chunk is compressed independently, its window being the chunk itself.
+ * A stream is a series of tokens:
+ *
+ * 0x00-0x7f: N+1 literal bytes follow.
+ * 0x80-0xff: copy (N & 0x7f)+3 bytes from D+1 bytes back, D being the next
+ *            byte.
+ */
+int lzchunk(unsigned char *src, int len, unsigned char *dst)
+{
+    int i = 0;
+    int o = 0;
+    int litstart = -1;
+    while (i < len) {
+        int bestlen = 0;
+        int bestdist = 0;
+        for (int j=0; j<i; j++) {
+            int l = 0;
+            while (i+l < len && l < LZ_MAX_MATCH && src[j+l] == src[i+l]) {
+                l++;
+            }
+            if (l >= bestlen) {
+                bestlen = l;
+                bestdist = i - j;
+            }
+        }
+        if (bestlen >= LZ_MIN_MATCH) {
+            litstart = -1;
+            dst[o++] = 0x80 | (bestlen - LZ_MIN_MATCH);
+            dst[o++] = bestdist - 1;
+            i += bestlen;
+        } else {
+            if (litstart < 0 || dst[litstart] == LZ_MAX_LITERALS-1) {
+                litstart = o;
+                dst[o++] = 0;
+            } else {
+                dst[litstart]++;
+            }
+            dst[o++] = src[i++];
+        }
+    }
+    return o;
+}
+
+/* Compresses len bytes of src into dst and returns compressed length.
+ *
+ * A compressed file starts with an index of 16-bit offsets, one per 0x100
+ * bytes chunk, pointing to the chunk's stream relative to the end of
+ * metadata. Streams follow.
+ */
+int lzfile(unsigned char *src, int len, unsigned char *dst)
+{
+    int chunkcount = (len + LZ_CHUNKSIZE - 1) / LZ_CHUNKSIZE;
+    int o = chunkcount * 2;
+    for (int i=0; i<chunkcount; i++) {
+        dst[i*2] = o & 0xff;
+        dst[i*2+1] = (o >> 8) & 0xff;
+        int clen = len - i*LZ_CHUNKSIZE;
+        if (clen > LZ_CHUNKSIZE) {
+            clen = LZ_CHUNKSIZE;
+        }
+        o += lzchunk(src+i*LZ_CHUNKSIZE, clen, dst+o);
+    }
+    return o;
+}
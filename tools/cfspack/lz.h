@@ -0,0 +1,13 @@
+/* LZ compression of CFS files (FLAG_LZ), shared by cfspack and the emulators'
+ * cfsdir. See lzfile() for the format.
+ */
+
+#define LZ_CHUNKSIZE 0x100
+// Compressed files are limited by their 16-bit size field rather than by their
+// block count.
+#define LZ_MAX_FILE_SIZE 0xffff
+// Worst case compressed size: a token for each 0x80 literals, plus the index.
+#define LZ_MAX_COMPRESSED(len) ((len) + ((len) / 0x80 + 1) * 3)
+
+int lzchunk(unsigned char *src, int len, unsigned char *dst);
+int lzfile(unsigned char *src, int len, unsigned char *dst);
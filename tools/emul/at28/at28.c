@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include "at28.h"
+
+// Brings the chip's state up to "now".
+static void update(AT28 *at28, unsigned now)
+{
+    if (at28->state == 1) {
+        unsigned elapsed = now - at28->since;
+        if (elapsed < AT28_TBLC) {
+            return;
+        }
+        // Byte load window is over, program the page.
+        for (int i=0; i<AT28_PAGE_SIZE; i++) {
+            if (at28->loaded[i]) {
+                at28->mem[at28->pageaddr+i] = at28->page[i];
+                at28->bytes++;
+            }
+        }
+        at28->cycles++;
+        at28->busy += AT28_TBLC;
+        at28->since += AT28_TBLC;
+        at28->state = 2;
+    }
+    if (at28->state == 2) {
+        unsigned elapsed = now - at28->since;
+        if (elapsed >= AT28_TWC) {
+            at28->busy += AT28_TWC;
+            at28->state = 0;
+        }
+    }
+}
+
+void at28_init(AT28 *at28)
+{
+    memset(at28, 0, sizeof(AT28));
+    // An erased EEPROM
+    memset(at28->mem, 0xff, AT28_SIZE);
+}
+
+uint8_t at28_read(AT28 *at28, uint16_t addr, unsigned now)
+{
+    update(at28, now);
+    if (at28->state == 0) {
+        return at28->mem[addr % AT28_SIZE];
+    }
+    at28->toggle ^= 0x40;
+    return ((~at28->lastval) & 0x80) | at28->toggle | (at28->lastval & 0x3f);
+}
+
+void at28_write(AT28 *at28, uint16_t addr, uint8_t val, unsigned now)
+{
+    update(at28, now);
+    if (at28->state == 2) {
+        at28->ignored++;
+        return;
+    }
+    if (at28->state == 0) {
+        memset(at28->loaded, 0, AT28_PAGE_SIZE);
+    } else {
+        // still in the byte load window, count the time spent loading.
+        at28->busy += now - at28->since;
+    }
+    addr %= AT28_SIZE;
+    at28->pageaddr = addr & ~(AT28_PAGE_SIZE-1);
+    at28->page[addr % AT28_PAGE_SIZE] = val;
+    at28->loaded[addr % AT28_PAGE_SIZE] = 1;
+    at28->lastval = val;
+    at28->since = now;
+    at28->state = 1;
+}
+
+// Pending page load and write cycles are completed before reporting.
+void at28_stats(AT28 *at28, FILE *fp)
+{
+    update(at28, at28->since + AT28_TBLC);
+    update(at28, at28->since + AT28_TWC);
+    fprintf(fp, "AT28: %u bytes in %u write cycles, %llu T-states (%llu ms)",
+        at28->bytes, at28->cycles, (unsigned long long)at28->busy,
+        (unsigned long long)at28->busy / AT28_CLOCK_KHZ);
+    if (at28->ignored) {
+        fprintf(fp, ", %u writes ignored", at28->ignored);
+    }
+    fprintf(fp, "\n");
+}
@@ -0,0 +1,51 @@
+#include <stdint.h>
+#include <stdio.h>
+
+/* AT28C64B EEPROM model
+ *
+ * Models the parts of the chip's behavior that matter when writing to it:
+ *
+ * - Page buffer: bytes written less than AT28_TBLC T-states apart are loaded
+ *   in a 64 bytes page buffer. Page address is latched on the last byte
+ *   loaded.
+ * - Write cycle: AT28_TBLC T-states after the last byte load, the page is
+ *   programmed, which takes AT28_TWC T-states. Writes during that time are
+ *   ignored.
+ * - Polling: during the byte load and write cycles, reads return the
+ *   complement of the last byte's bit 7 (data polling) and bit 6 toggles at
+ *   each read (toggle bit polling).
+ *
+ * Timings assume a 7.3728 MHz clock (the RC2014's).
+ */
+
+#define AT28_SIZE 0x2000
+#define AT28_PAGE_SIZE 0x40
+#define AT28_CLOCK_KHZ 7373
+// Byte load cycle time: 150us
+#define AT28_TBLC (AT28_CLOCK_KHZ * 150 / 1000)
+// Write cycle time: 10ms
+#define AT28_TWC (AT28_CLOCK_KHZ * 10)
+
+typedef struct {
+    uint8_t mem[AT28_SIZE];
+    uint8_t page[AT28_PAGE_SIZE];
+    uint8_t loaded[AT28_PAGE_SIZE];
+    uint16_t pageaddr;
+    uint8_t lastval;
+    uint8_t toggle;
+    // 0 = idle, 1 = loading page, 2 = write cycle
+    int state;
+    // T-state count at last byte load or at the beginning of the write
+    // cycle, depending on state.
+    unsigned since;
+    // Stats
+    unsigned cycles;        // number of write cycles
+    unsigned bytes;         // number of bytes programmed
+    unsigned ignored;       // number of writes ignored during a write cycle
+    uint64_t busy;          // T-states spent loading and writing pages
+} AT28;
+
+void at28_init(AT28 *at28);
+uint8_t at28_read(AT28 *at28, uint16_t addr, unsigned now);
+void at28_write(AT28 *at28, uint16_t addr, uint8_t val, unsigned now);
+void at28_stats(AT28 *at28, FILE *fp);
@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cfsdir.h"
+#include "../../cfspack/lz.h"
+
+// In sync with cfspack
+#define MAX_FN_LEN 24
+#define MAX_FILE_SIZE (CFSDIR_BLKSIZE * 0xff - CFSDIR_METASIZE)
+#define MAX_LARGE_FN_LEN 22
+#define MAX_LARGE_FILE_SIZE (CFSDIR_BLKSIZE * 0xffff - CFSDIR_METASIZE)
+#define FLAG_LZ 0x01
+#define FLAG_LARGE 0x02
+// In sync with fs.asm
+#define META_ALLOC 0x03
+#define META_FSIZE 0x04
+#define META_FNAME 0x06
+#define META_ALLOCH 0x1d
+#define META_FSIZEH 0x1e
+#define META_FLAGS 0x1f
+#define MAX_PATH 0x1000
+
+static int islarge(CFSDirFile *f)
+{
+    return f->meta[META_FLAGS] & FLAG_LARGE;
+}
+
+static uint32_t capacity(CFSDirFile *f)
+{
+    return f->blockcount * CFSDIR_BLKSIZE - CFSDIR_METASIZE;
+}
+
+static uint32_t metaalloc(uint8_t *meta)
+{
+    uint32_t count = meta[META_ALLOC];
+    if (meta[META_FLAGS] & FLAG_LARGE) {
+        count |= meta[META_ALLOCH] << 8;
+    }
+    return count;
+}
+
+static uint32_t metasize(uint8_t *meta)
+{
+    uint32_t size = meta[META_FSIZE] | (meta[META_FSIZE+1] << 8);
+    if (meta[META_FLAGS] & FLAG_LARGE) {
+        size |= meta[META_FSIZEH] << 16;
+    }
+    return size;
+}
+
+static void setmetasize(CFSDirFile *f, uint32_t size)
+{
+    f->meta[META_FSIZE] = size & 0xff;
+    f->meta[META_FSIZE+1] = (size >> 8) & 0xff;
+    if (islarge(f)) {
+        f->meta[META_FSIZEH] = (size >> 16) & 0xff;
+    }
+}
+
+// Copies the name field of meta in name, which is CFSDIR_METASIZE bytes big.
+static void metaname(uint8_t *meta, char *name)
+{
+    int maxlen = (meta[META_FLAGS] & FLAG_LARGE) ? MAX_LARGE_FN_LEN : MAX_FN_LEN;
+    memset(name, 0, CFSDIR_METASIZE);
+    for (int i=0; i<maxlen && meta[META_FNAME+i]; i++) {
+        name[i] = meta[META_FNAME+i];
+    }
+}
+
+static int addfile(CFSDir *cd, char *path, char *fn)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Can't stat %s\n", path);
+        return 1;
+    }
+    long fsize = st.st_size;
+    if (fsize > MAX_LARGE_FILE_SIZE) {
+        fprintf(stderr, "File too big: %s %ld\n", path, fsize);
+        return 1;
+    }
+    if (strlen(fn) > MAX_FN_LEN) {
+        fprintf(stderr, "Filename too long: %s\n", fn);
+        return 1;
+    }
+    uint8_t *lzdata = NULL;
+    long datasize = fsize;
+    if (cd->compress && (fsize > 0) && (fsize <= LZ_MAX_FILE_SIZE)) {
+        // Same as cfspack -c: only compress if it's worth it.
+        static uint8_t buf[LZ_MAX_FILE_SIZE];
+        static uint8_t lzbuf[LZ_MAX_COMPRESSED(LZ_MAX_FILE_SIZE)];
+        FILE *fp = fopen(path, "rb");
+        if ((fp == NULL) || (fread(buf, fsize, 1, fp) != 1)) {
+            fprintf(stderr, "Can't read %s\n", path);
+            if (fp != NULL) {
+                fclose(fp);
+            }
+            return 1;
+        }
+        fclose(fp);
+        long lzsize = lzfile(buf, fsize, lzbuf);
+        if ((lzsize < fsize) && (lzsize <= MAX_FILE_SIZE)) {
+            // Padded to whole blocks, see capacity()
+            lzdata = calloc(lzsize + CFSDIR_BLKSIZE, 1);
+            if (lzdata == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+            memcpy(lzdata, lzbuf, lzsize);
+            datasize = lzsize;
+        }
+    }
+    int large = datasize > MAX_FILE_SIZE;
+    if (large && strlen(fn) > MAX_LARGE_FN_LEN) {
+        fprintf(stderr, "Filename too long for a large file: %s\n", fn);
+        return 1;
+    }
+    // Same block count as cfspack: at least one, which holds metadata.
+    uint32_t blockcount = 1;
+    if (datasize > CFSDIR_BLKSIZE - CFSDIR_METASIZE) {
+        blockcount += (datasize - (CFSDIR_BLKSIZE - CFSDIR_METASIZE)) / CFSDIR_BLKSIZE;
+    }
+    if (blockcount * CFSDIR_BLKSIZE < datasize + CFSDIR_METASIZE) {
+        blockcount++;
+    }
+    CFSDirFile *files = realloc(cd->files, (cd->count + 1) * sizeof(CFSDirFile));
+    if (files == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(lzdata);
+        return 1;
+    }
+    cd->files = files;
+    CFSDirFile *f = &cd->files[cd->count];
+    memset(f, 0, sizeof(CFSDirFile));
+    f->path = strdup(path);
+    f->start = cd->size;
+    f->blockcount = blockcount;
+    memcpy(f->meta, "CFS", 3);
+    f->meta[META_ALLOC] = blockcount & 0xff;
+    strncpy((char *)&f->meta[META_FNAME], fn, MAX_FN_LEN);
+    if (large) {
+        f->meta[META_ALLOCH] = (blockcount >> 8) & 0xff;
+        f->meta[META_FLAGS] = FLAG_LARGE;
+    }
+    if (lzdata != NULL) {
+        f->data = lzdata;
+        f->meta[META_FLAGS] = FLAG_LZ;
+    }
+    setmetasize(f, fsize);
+    metaname(f->meta, f->name);
+    cd->count++;
+    cd->size += blockcount * CFSDIR_BLKSIZE;
+    return 0;
+}
+
+static int adddir(CFSDir *cd, char *path, char *prefix, char *pattern)
+{
+    DIR *dp;
+    struct dirent *ep;
+
+    int prefixlen = strlen(prefix);
+    dp = opendir(path);
+    if (dp == NULL) {
+        fprintf(stderr, "Couldn't open directory %s\n", path);
+        return 1;
+    }
+    while ((ep = readdir(dp))) {
+        if ((strcmp(ep->d_name, ".") == 0) || strcmp(ep->d_name, "..") == 0) {
+            continue;
+        }
+        if (ep->d_type != DT_DIR && ep->d_type != DT_REG) {
+            fprintf(stderr, "Only regular file or directories are supported\n");
+            closedir(dp);
+            return 1;
+        }
+        // +1 for the "/" after the prefix
+        int slen = strlen(ep->d_name) + (prefixlen > 0 ? 1 : 0);
+        if (prefixlen + slen > MAX_FN_LEN) {
+            fprintf(stderr, "Filename too long: %s/%s\n", prefix, ep->d_name);
+            closedir(dp);
+            return 1;
+        }
+        char fullpath[MAX_PATH];
+        if (snprintf(fullpath, sizeof(fullpath), "%s/%s", path, ep->d_name) >=
+                (int)sizeof(fullpath)) {
+            fprintf(stderr, "Path too long: %s/%s\n", path, ep->d_name);
+            closedir(dp);
+            return 1;
+        }
+        // Fits: we've checked the length above.
+        char newprefix[MAX_FN_LEN+1];
+        if (prefixlen > 0) {
+            snprintf(newprefix, sizeof(newprefix), "%s/%s", prefix, ep->d_name);
+        } else {
+            snprintf(newprefix, sizeof(newprefix), "%s", ep->d_name);
+        }
+        int r = 0;
+        if (ep->d_type == DT_DIR) {
+            r = adddir(cd, fullpath, newprefix, pattern);
+        } else if (!pattern || fnmatch(pattern, ep->d_name, 0) == 0) {
+            r = addfile(cd, fullpath, newprefix);
+        }
+        if (r != 0) {
+            closedir(dp);
+            return r;
+        }
+    }
+    closedir(dp);
+    return 0;
+}
+
+// Index of the file holding addr, which is within the laid out part.
+static int findfile(CFSDir *cd, uint32_t addr)
+{
+    int lo = 0;
+    int hi = cd->count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (cd->files[mid].start <= addr) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+static int flushblock(CFSDir *cd)
+{
+    if (!cd->bdirty) {
+        return 0;
+    }
+    CFSDirFile *f = &cd->files[cd->bfile];
+    FILE *fp = fopen(f->path, "r+b");
+    if (fp == NULL) {
+        // The host file is gone, recreate it.
+        fp = fopen(f->path, "wb");
+    }
+    if (fp == NULL) {
+        fprintf(stderr, "Can't write to %s\n", f->path);
+        return 1;
+    }
+    fseek(fp, cd->boffset, SEEK_SET);
+    fwrite(cd->buf, cd->blen, 1, fp);
+    fclose(fp);
+    cd->bdirty = 0;
+    cd->blkwrites++;
+    return 0;
+}
+
+static void dropblock(CFSDir *cd)
+{
+    flushblock(cd);
+    cd->bfile = -1;
+}
+
+// Loads the block holding offset of file index in the block buffer.
+static void loadblock(CFSDir *cd, int index, uint32_t offset)
+{
+    offset &= ~(CFSDIR_BLKSIZE-1);
+    if ((cd->bfile == index) && (cd->boffset == offset)) {
+        return;
+    }
+    dropblock(cd);
+    memset(cd->buf, 0, CFSDIR_BLKSIZE);
+    cd->bfile = index;
+    cd->boffset = offset;
+    cd->blen = 0;
+    FILE *fp = fopen(cd->files[index].path, "rb");
+    if (fp != NULL) {
+        if (fseek(fp, offset, SEEK_SET) == 0) {
+            cd->blen = fread(cd->buf, 1, CFSDIR_BLKSIZE, fp);
+        }
+        fclose(fp);
+    }
+    cd->blkreads++;
+}
+
+// Picks up host changes to the size of a file.
+static void refresh(CFSDir *cd, int index)
+{
+    CFSDirFile *f = &cd->files[index];
+    if (f->resized || (f->data != NULL)) {
+        // The guest's size wins until we sync. Compressed files don't change.
+        return;
+    }
+    if (cd->bfile == index) {
+        dropblock(cd);
+    }
+    struct stat st;
+    if (stat(f->path, &st) != 0) {
+        return;
+    }
+    uint32_t size = st.st_size;
+    if (size > capacity(f)) {
+        size = capacity(f);
+    }
+    setmetasize(f, size);
+}
+
+void cfsdir_init(CFSDir *cd)
+{
+    memset(cd, 0, sizeof(CFSDir));
+    cd->bfile = -1;
+}
+
+int cfsdir_add(CFSDir *cd, char *path, char *pattern)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Can't stat %s\n", path);
+        return 1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        if (cd->root == NULL) {
+            cd->root = strdup(path);
+        }
+        return adddir(cd, path, "", pattern);
+    }
+    // special case: just one file
+    char *tmp = strdup(path);
+    int r = addfile(cd, path, basename(tmp));
+    free(tmp);
+    return r;
+}
+
+uint32_t cfsdir_size(CFSDir *cd)
+{
+    return cd->size + cd->tailsize;
+}
+
+int cfsdir_read(CFSDir *cd, uint32_t addr)
+{
+    if (addr >= cd->size) {
+        addr -= cd->size;
+        return addr < cd->tailsize ? cd->tail[addr] : -1;
+    }
+    int index = findfile(cd, addr);
+    CFSDirFile *f = &cd->files[index];
+    uint32_t offset = addr - f->start;
+    if (offset < CFSDIR_METASIZE) {
+        if (offset == 0) {
+            refresh(cd, index);
+        }
+        return f->meta[offset];
+    }
+    offset -= CFSDIR_METASIZE;
+    if (f->data != NULL) {
+        return f->data[offset];
+    }
+    loadblock(cd, index, offset);
+    // Past the end of the host file, we have zeroes.
+    return cd->buf[offset % CFSDIR_BLKSIZE];
+}
+
+int cfsdir_write(CFSDir *cd, uint32_t addr, uint8_t val)
+{
+    if (addr >= cd->size) {
+        addr -= cd->size;
+        if (addr == cd->tailsize) {
+            if (cd->tailsize == CFSDIR_MAX_TAIL) {
+                return 1;
+            }
+            if (cd->tailsize % CFSDIR_BLKSIZE == 0) {
+                uint8_t *tail = realloc(cd->tail, cd->tailsize + CFSDIR_BLKSIZE);
+                if (tail == NULL) {
+                    return 1;
+                }
+                cd->tail = tail;
+            }
+            cd->tailsize++;
+        } else if (addr > cd->tailsize) {
+            return 1;
+        }
+        cd->tail[addr] = val;
+        return 0;
+    }
+    int index = findfile(cd, addr);
+    CFSDirFile *f = &cd->files[index];
+    uint32_t offset = addr - f->start;
+    if (offset < CFSDIR_METASIZE) {
+        // Metadata is always written whole. Only actual changes count.
+        if (f->meta[offset] != val) {
+            if ((offset == META_FSIZE) || (offset == META_FSIZE+1) ||
+                    (islarge(f) && (offset == META_FSIZEH))) {
+                f->resized = 1;
+            }
+            f->meta[offset] = val;
+        }
+        return 0;
+    }
+    offset -= CFSDIR_METASIZE;
+    if (f->data != NULL) {
+        return 1;   // read-only
+    }
+    loadblock(cd, index, offset);
+    int i = offset % CFSDIR_BLKSIZE;
+    // Caches write whole blocks back. Unchanged bytes, which include the
+    // zeroes past the end of the host file, don't touch the host file. If
+    // the guest's file ends with such zeroes, truncate() adds them on sync.
+    if (cd->buf[i] == val) {
+        return 0;
+    }
+    cd->buf[i] = val;
+    if (i >= cd->blen) {
+        cd->blen = i + 1;
+    }
+    cd->bdirty = 1;
+    return 0;
+}
+
+// Writes files the guest created at the end of the image in cd->root. Each is
+// written in a temporary file next to it first, then renamed, so that a failed
+// write doesn't leave a truncated file behind.
+static int synctail(CFSDir *cd)
+{
+    int r = 0;
+    uint32_t pos = 0;
+    while (pos + CFSDIR_METASIZE <= cd->tailsize) {
+        uint8_t *meta = &cd->tail[pos];
+        uint32_t alloc = metaalloc(meta);
+        if ((memcmp(meta, "CFS", 3) != 0) || (alloc == 0)) {
+            break;
+        }
+        char name[CFSDIR_METASIZE];
+        metaname(meta, name);
+        uint32_t size = metasize(meta);
+        uint32_t avail = cd->tailsize - pos - CFSDIR_METASIZE;
+        if (size > avail) {
+            size = avail;
+        }
+        pos += alloc * CFSDIR_BLKSIZE;
+        if (name[0] == 0) {
+            continue;   // deleted
+        }
+        if (cd->root == NULL) {
+            fprintf(stderr, "No directory to write %s in\n", name);
+            r = 1;
+            continue;
+        }
+        char path[MAX_PATH];
+        char tmppath[MAX_PATH];
+        if ((snprintf(path, sizeof(path), "%s/%s", cd->root, name) >=
+                (int)sizeof(path)) ||
+                (snprintf(tmppath, sizeof(tmppath), "%s.XXXXXX", path) >=
+                (int)sizeof(tmppath))) {
+            fprintf(stderr, "Path too long: %s/%s\n", cd->root, name);
+            r = 1;
+            continue;
+        }
+        int fd = mkstemp(tmppath);
+        FILE *fp = fd < 0 ? NULL : fdopen(fd, "wb");
+        if (fp == NULL) {
+            fprintf(stderr, "Can't write %s\n", path);
+            if (fd >= 0) {
+                close(fd);
+                unlink(tmppath);
+            }
+            r = 1;
+            continue;
+        }
+        int ok = (size == 0) || (fwrite(meta + CFSDIR_METASIZE, size, 1, fp) == 1);
+        ok = (fclose(fp) == 0) && ok;
+        if (!ok || (rename(tmppath, path) != 0)) {
+            fprintf(stderr, "Can't write %s\n", path);
+            unlink(tmppath);
+            r = 1;
+        }
+    }
+    return r;
+}
+
+int cfsdir_sync(CFSDir *cd)
+{
+    int r = flushblock(cd);
+    for (int i=0; i<cd->count; i++) {
+        CFSDirFile *f = &cd->files[i];
+        char name[CFSDIR_METASIZE];
+        metaname(f->meta, name);
+        if (name[0] == 0) {
+            continue;   // deleted
+        }
+        if (f->resized) {
+            if (truncate(f->path, metasize(f->meta)) != 0) {
+                fprintf(stderr, "Can't resize %s\n", f->path);
+                r = 1;
+            }
+            f->resized = 0;
+        }
+        if (strcmp(name, f->name) != 0) {
+            // The file stays relative to the directory it was added from: its
+            // path ends with its name.
+            int dirlen = strlen(f->path) - strlen(f->name);
+            char path[MAX_PATH];
+            if ((snprintf(path, sizeof(path), "%.*s%s", dirlen, f->path,
+                    name) >= (int)sizeof(path)) ||
+                    (rename(f->path, path) != 0)) {
+                fprintf(stderr, "Can't rename %s to %s\n", f->path, path);
+                r = 1;
+                continue;
+            }
+            free(f->path);
+            f->path = strdup(path);
+            strcpy(f->name, name);
+        }
+    }
+    return synctail(cd) || r;
+}
+
+void cfsdir_stats(CFSDir *cd, FILE *fp)
+{
+    fprintf(fp, "CFSDir: %d files, %u blocks read, %u blocks written\n",
+        cd->count, cd->blkreads, cd->blkwrites);
+}
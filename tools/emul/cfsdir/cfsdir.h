@@ -0,0 +1,86 @@
+#include <stdint.h>
+#include <stdio.h>
+
+/* Host directory as a CFS blockdev
+ *
+ * Serves host files as a CFS image without packing them first. When a file or
+ * directory is added, we only stat() its files and lay out their metadata the
+ * way cfspack would. File data is read from the host, a 0x100 bytes block at a
+ * time, when the guest reads it. Startup time doesn't depend on the size of
+ * the files and the guest sees host edits without a repack: sizes in metadata
+ * are refreshed each time the guest reads the beginning of a metadata block.
+ * A file can't show more than what was allocated to it when it was added,
+ * though.
+ *
+ * Guest writes go back to the host:
+ *
+ * - Data is written to the host file at the corresponding offset.
+ * - Size changes (fsSetSize) truncate the host file on cfsdir_sync().
+ * - When fsAlloc re-uses the blocks of a deleted file, the host file is
+ *   renamed on cfsdir_sync(), within the directory it was added from.
+ *   Deleting a file doesn't delete the host file.
+ * - Files that fsAlloc creates at the end of the image are kept in memory and
+ *   written by cfsdir_sync() in the first directory that was added.
+ *
+ * With compress set before adding files, they're compressed the way cfspack -c
+ * does it (see cfspack/lz.h). Those are read and compressed when they're added
+ * and are read-only, like in Collapse OS. zasm uses it for its includes.
+ */
+
+#define CFSDIR_BLKSIZE 0x100
+#define CFSDIR_METASIZE 0x20
+// What the guest allocates past the end of the image is kept in memory, up to
+// that size.
+#define CFSDIR_MAX_TAIL 0x100000
+
+typedef struct {
+    char *path;
+    // Address of the metadata block
+    uint32_t start;
+    uint32_t blockcount;
+    uint8_t meta[CFSDIR_METASIZE];
+    // Name when added, to detect renames
+    char name[CFSDIR_METASIZE];
+    // The guest changed the size in metadata
+    int resized;
+    // Compressed data, served instead of the host file. NULL if the file
+    // isn't compressed.
+    uint8_t *data;
+} CFSDirFile;
+
+typedef struct {
+    // Where new files go
+    char *root;
+    // Compress files when they're added
+    int compress;
+    CFSDirFile *files;
+    int count;
+    // Size of the laid out part of the image. The tail follows.
+    uint32_t size;
+    uint8_t *tail;
+    uint32_t tailsize;
+    // Block buffer: file index (-1 when empty), offset of the block in that
+    // file and number of valid bytes in it.
+    int bfile;
+    uint32_t boffset;
+    int blen;
+    int bdirty;
+    uint8_t buf[CFSDIR_BLKSIZE];
+    // Stats
+    unsigned blkreads;
+    unsigned blkwrites;
+} CFSDir;
+
+void cfsdir_init(CFSDir *cd);
+// Adds a file or, recursively, the files of a directory matching pattern
+// (all of them if NULL). Returns 0 on success.
+int cfsdir_add(CFSDir *cd, char *path, char *pattern);
+uint32_t cfsdir_size(CFSDir *cd);
+// Returns the byte at addr, or -1 if addr is out of bounds.
+int cfsdir_read(CFSDir *cd, uint32_t addr);
+// Writes val at addr. Writing at cfsdir_size() grows the image. Returns 0 on
+// success.
+int cfsdir_write(CFSDir *cd, uint32_t addr, uint8_t val);
+// Applies pending changes to host files. Returns 0 on success.
+int cfsdir_sync(CFSDir *cd);
+void cfsdir_stats(CFSDir *cd, FILE *fp);
@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "guard.h"
+
+// How many instructions we run between clock checks
+#define GUARD_CLOCK_INTERVAL 0x10000
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void guard_init(Guard *g)
+{
+    memset(g, 0, sizeof(Guard));
+}
+
+int guard_opt(Guard *g, int c, char *arg)
+{
+    switch (c) {
+    case 'b':
+        g->budget = strtoull(arg, NULL, 0);
+        return 1;
+    case 't':
+        g->timeout = strtoul(arg, NULL, 0);
+        return 1;
+    case 's':
+        g->stats = 1;
+        return 1;
+    }
+    return 0;
+}
+
+int guard_run(Guard *g, Z80Context *cpu)
+{
+    double start = now();
+    unsigned prev = cpu->tstates;
+    int res = 0;
+    while (!cpu->halted && !g->stop) {
+        Z80Execute(cpu);
+        g->instrs++;
+        // tstates is only 32-bit, it wraps on long runs.
+        g->tstates += (unsigned)(cpu->tstates - prev);
+        prev = cpu->tstates;
+        if (g->budget && (g->instrs >= g->budget)) {
+            fprintf(stderr, GUARD_MSG "instruction budget exceeded\n");
+            res = GUARD_EXIT_CODE;
+            break;
+        }
+        if (g->timeout && ((g->instrs % GUARD_CLOCK_INTERVAL) == 0)) {
+            if (now() - start >= g->timeout) {
+                fprintf(stderr, GUARD_MSG "timeout\n");
+                res = GUARD_EXIT_CODE;
+                break;
+            }
+        }
+    }
+    g->secs = now() - start;
+    if (g->stats) {
+        guard_stats(g, stderr);
+    }
+    return res;
+}
+
+void guard_stats(Guard *g, FILE *fp)
+{
+    fprintf(fp, "instrs %llu tstates %llu secs %.3f\n",
+        (unsigned long long)g->instrs, (unsigned long long)g->tstates,
+        g->secs);
+}
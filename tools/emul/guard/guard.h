@@ -0,0 +1,38 @@
+#include <stdint.h>
+#include <stdio.h>
+#include "../libz80/z80.h"
+
+/* Runs a CPU until it halts, within an instruction budget and a wall-clock
+ * timeout. This keeps a test that loops forever from hanging everything.
+ *
+ * When either limit is reached, a line starting with GUARD_MSG is printed to
+ * stderr and the program is expected to exit with GUARD_EXIT_CODE. That code
+ * is ambiguous with runbin, whose exit code is the value of A, so look for the
+ * message to be sure. Tools using it take these options:
+ *
+ * -b <count>: instruction budget (0 means no limit, the default)
+ * -t <secs>: wall-clock timeout (0 means no limit, the default)
+ * -s: print stats (instructions, T-states, time) to stderr when done
+ */
+
+#define GUARD_EXIT_CODE 124
+#define GUARD_MSG "guard: "
+
+typedef struct {
+    uint64_t budget;
+    unsigned timeout;
+    int stats;
+    uint64_t instrs;
+    uint64_t tstates;
+    double secs;
+    // Set by I/O handlers to end the run before the CPU halts.
+    int stop;
+} Guard;
+
+void guard_init(Guard *g);
+// Handles option c with argument arg. Returns 0 if option is not ours.
+int guard_opt(Guard *g, int c, char *arg);
+// Returns 0 if cpu halted or stop was set, GUARD_EXIT_CODE if a limit was
+// reached.
+int guard_run(Guard *g, Z80Context *cpu);
+void guard_stats(Guard *g, FILE *fp);
@@ -1,13 +1,34 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "../libz80/z80.h"
+#include "../at28/at28.h"
+#include "../guard/guard.h"
 
 /* runbin loads binary from stdin directly in memory address 0 then runs it
  * until it halts. The return code is the value of the register A at halt time.
+ *
+ * With the -a flag, an AT28C64B EEPROM is mapped at AT28_START and its stats
+ * are printed to stderr at halt time.
+ *
+ * Also takes guard options (-b, -t and -s, see guard/guard.h). When a guard
+ * limit is reached, exit code is GUARD_EXIT_CODE.
  */
 
+// in sync with AT28W_MEMSTART
+#define AT28_START 0x2000
+
 static Z80Context cpu;
 static uint8_t mem[0x10000];
+static AT28 at28;
+static int has_at28 = 0;
+static Guard guard;
+
+static int is_at28(uint16_t addr)
+{
+    return has_at28 && (addr >= AT28_START) && (addr < AT28_START+AT28_SIZE);
+}
 
 static uint8_t io_read(int unused, uint16_t addr)
 {
@@ -24,19 +45,37 @@ static void io_write(int unused, uint16_t addr, uint8_t val)
 
 static uint8_t mem_read(int unused, uint16_t addr)
 {
+    if (is_at28(addr)) {
+        return at28_read(&at28, addr-AT28_START, cpu.tstates);
+    }
     return mem[addr];
 }
 
 static void mem_write(int unused, uint16_t addr, uint8_t val)
 {
+    if (is_at28(addr)) {
+        at28_write(&at28, addr-AT28_START, val, cpu.tstates);
+        return;
+    }
     mem[addr] = val;
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    guard_init(&guard);
+    int c;
+    while ((c = getopt(argc, argv, "ab:t:s")) != -1) {
+        if (c == 'a') {
+            has_at28 = 1;
+            at28_init(&at28);
+        } else if (!guard_opt(&guard, c, optarg)) {
+            fprintf(stderr, "Usage: runbin [-a] [-b budget] [-t secs] [-s] < binary\n");
+            return 1;
+        }
+    }
     // read stdin in mem
     int i = 0;
-    int c = getchar();
+    c = getchar();
     while (c != EOF) {
         mem[i] = c & 0xff;
         i++;
@@ -52,8 +91,12 @@ int main()
     cpu.memRead = mem_read;
     cpu.memWrite = mem_write;
 
-    while (!cpu.halted) {
-        Z80Execute(&cpu);
+    int res = guard_run(&guard, &cpu);
+    if (has_at28) {
+        at28_stats(&at28, stderr);
+    }
+    if (res != 0) {
+        return res;
     }
     return cpu.R1.br.A;
 }
@@ -1,33 +1,64 @@
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <termios.h>
+#include <time.h>
+#include <unistd.h>
 #include "../libz80/z80.h"
+#include "../at28/at28.h"
+#include "../cfsdir/cfsdir.h"
 #include "kernel-bin.h"
 
 /* Collapse OS shell with filesystem
  *
- * On startup, if "cfsin" directory exists, it packs it as a afke block device
- * and loads it in. Upon halting, unpcks the contents of that block device in
- * "cfsout" directory.
+ * On startup, if "cfsin" directory exists, it packs it as a fake block device
+ * and loads it in. Changes to that block device are lost when we exit.
+ *
+ * With "-d dir", the block device is "dir" itself, served through cfsdir (see
+ * cfsdir/cfsdir.h): files are read from the host as the shell needs them and
+ * changes are written back to "dir".
+ *
+ * stdin is normally a terminal. It can also be a pipe or a file, which is how
+ * tools/tests/shell feeds it commands. The shell then exits at the end of it.
  *
  * Memory layout:
  *
- * 0x0000 - 0x3fff: ROM code from shell.asm
- * 0x4000 - 0x4fff: Kernel memory
- * 0x5000 - 0xffff: Userspace
+ * 0x0000 - 0x1fff: ROM code from shell.asm
+ * 0x2000 - 0x3fff: AT28C64B EEPROM (see at28/at28.h), for apps/at28w
+ * 0x4000 - 0x47ff: Kernel memory (KERNEL_RAMEND in shell_.asm)
+ * 0x4800 - 0xffff: Userspace (USER_CODE in user.h)
  *
  * I/O Ports:
  *
  * 0 - stdin / stdout
  * 1 - Filesystem blockdev data read/write. Reads and write data to the address
  *     previously selected through port 2
+ * 2 - Filesystem blockdev address, see FS_ADDR_PORT
+ * 3 - stdin status, see STDIN_STATUS_PORT
+ * 4 - Timer, see TIMER_PORT
+ *
+ * The timer raises an interrupt at a fixed period, in T-states, that the kernel
+ * programs. When it's used, we print on exit how many T-states went into
+ * interrupt handlers and how many were spent waiting for input, and how much
+ * fsdev writing was done during that wait.
+ *
+ * While the guest waits for input, that is, from the first time it finds
+ * nothing on the stdin status port until it reads stdin, it runs at CPU_HZ:
+ * when it gets ahead of the host's clock, we sleep until it's caught up or
+ * until input comes. Otherwise, it runs as fast as it can. T-states spent
+ * waiting for input are thus the time spent waiting at CPU_HZ.
  */
 
 //#define DEBUG
-#define MAX_FSDEV_SIZE 0x20000
+// Big enough for a few large CFS files
+#define MAX_FSDEV_SIZE 0x100000
+// Speed of the guest while it waits for input, in sync with TIMER_PERIOD
+#define CPU_HZ 4000000
 
 // in sync with shell.asm
 #define RAMSTART 0x4000
+// in sync with AT28W_MEMSTART
+#define AT28_START 0x2000
 #define STDIO_PORT 0x00
 #define FS_DATA_PORT 0x01
 // Controls what address (24bit) the data port returns. To select an address,
@@ -38,6 +69,13 @@
 // 2 means more than fsdev size (always invalid)
 // 3 means incomplete addr setting
 #define FS_ADDR_PORT 0x02
+// Reading this port returns 1 if a char can be read from port 0 without
+// blocking (or if we're at EOF), 0 otherwise.
+#define STDIN_STATUS_PORT 0x03
+// Writing to this port twice, LSB first, sets the timer period in T-states. 0
+// stops the timer. Reading it twice returns, LSB first, the number of T-states
+// since the last tick, latched on the first read.
+#define TIMER_PORT 0x04
 
 static Z80Context cpu;
 static uint8_t mem[0xffff] = {0};
@@ -47,11 +85,91 @@ static uint32_t fsdev_ptr = 0;
 // 0 = idle, 1 = received MSB (of 24bit addr), 2 = received middle addr
 static int  fsdev_addr_lvl = 0;
 static int running;
+static AT28 at28;
+// When set, fsdev is served by cfsdir instead of the fsdev array.
+static int use_cfsdir = 0;
+static CFSDir cfsdir;
+// Timer. *_lvl are 1 between the first and the second access to TIMER_PORT.
+static unsigned timer_period = 0;
+static unsigned timer_count = 0;
+static unsigned timer_latch = 0;
+static int timer_wlvl = 0;
+static int timer_rlvl = 0;
+static unsigned timer_ticks = 0;
+// Stats. in_int is 1 during an interrupt handler, 2 on the instruction
+// following its "ei".
+static int in_int = 0;
+static uint64_t tstates = 0;
+static uint64_t int_tstates = 0;
+static int stdin_waiting = 0;
+static uint64_t stdin_wait_start = 0;
+static double stdin_wait_host_start = 0;
+static uint64_t stdin_wait_tstates = 0;
+static unsigned fsdev_writes = 0;
+static unsigned fsdev_writes_waiting = 0;
+
+static uint8_t fsdev_read(uint32_t addr)
+{
+    if (use_cfsdir) {
+        return cfsdir_read(&cfsdir, addr) & 0xff;
+    }
+    return fsdev[addr];
+}
+
+// Writes val at addr, which can be fsdev_size, in which case the device grows.
+// Returns 0 on success.
+static int fsdev_write(uint32_t addr, uint8_t val)
+{
+    if (use_cfsdir) {
+        if (cfsdir_write(&cfsdir, addr, val) != 0) {
+            return 1;
+        }
+        fsdev_size = cfsdir_size(&cfsdir);
+        return 0;
+    }
+    if (addr == MAX_FSDEV_SIZE) {
+        return 1;
+    }
+    fsdev[addr] = val;
+    if (addr == fsdev_size) {
+        fsdev_size++;
+    }
+    return 0;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int stdin_ready()
+{
+    struct pollfd fds = {0, POLLIN, 0};
+    if (poll(&fds, 1, 0) != 0) {
+        return 1;
+    }
+    if (!stdin_waiting) {
+        return 0;
+    }
+    // The guest is idle. Don't let it run ahead of CPU_HZ.
+    double ahead = (double)(tstates - stdin_wait_start) / CPU_HZ -
+        (now() - stdin_wait_host_start);
+    if (ahead < 0.001) {
+        return 0;
+    }
+    return poll(&fds, 1, ahead * 1000) != 0;
+}
 
 static uint8_t io_read(int unused, uint16_t addr)
 {
     addr &= 0xff;
     if (addr == STDIO_PORT) {
+        if (stdin_waiting) {
+            stdin_wait_tstates += tstates - stdin_wait_start;
+            stdin_waiting = 0;
+        }
         int c = getchar();
         if (c == EOF) {
             running = 0;
@@ -66,7 +184,7 @@ static uint8_t io_read(int unused, uint16_t addr)
 #ifdef DEBUG
             fprintf(stderr, "Reading FSDEV at offset %d\n", fsdev_ptr);
 #endif
-            return fsdev[fsdev_ptr];
+            return fsdev_read(fsdev_ptr);
         } else {
             // don't warn when ==, we're not out of bounds, just at the edge.
             if (fsdev_ptr > fsdev_size) {
@@ -85,6 +203,25 @@ static uint8_t io_read(int unused, uint16_t addr)
         } else {
             return 0;
         }
+    } else if (addr == STDIN_STATUS_PORT) {
+        if (stdin_ready()) {
+            return 1;
+        }
+        if (!stdin_waiting) {
+            stdin_waiting = 1;
+            stdin_wait_start = tstates;
+            stdin_wait_host_start = now();
+        }
+        return 0;
+    } else if (addr == TIMER_PORT) {
+        if (timer_rlvl == 0) {
+            timer_latch = timer_count;
+            timer_rlvl = 1;
+            return timer_latch & 0xff;
+        } else {
+            timer_rlvl = 0;
+            return (timer_latch >> 8) & 0xff;
+        }
     } else {
         fprintf(stderr, "Out of bounds I/O read: %d\n", addr);
         return 0;
@@ -105,18 +242,15 @@ static void io_write(int unused, uint16_t addr, uint8_t val)
             fprintf(stderr, "Writing to FSDEV in the middle of an addr op (%d)\n", fsdev_ptr);
             return;
         }
-        if (fsdev_ptr < fsdev_size) {
+        // We can write at fsdev_size, it grows fsdev.
+        if ((fsdev_ptr <= fsdev_size) && (fsdev_write(fsdev_ptr, val) == 0)) {
 #ifdef DEBUG
             fprintf(stderr, "Writing to FSDEV (%d)\n", fsdev_ptr);
 #endif
-            fsdev[fsdev_ptr] = val;
-        } else if ((fsdev_ptr == fsdev_size) && (fsdev_ptr < MAX_FSDEV_SIZE)) {
-            // We're at the end of fsdev, grow it
-            fsdev[fsdev_ptr] = val;
-            fsdev_size++;
-#ifdef DEBUG
-            fprintf(stderr, "Growing FSDEV (%d)\n", fsdev_ptr);
-#endif
+            fsdev_writes++;
+            if (stdin_waiting) {
+                fsdev_writes_waiting++;
+            }
         } else {
             fprintf(stderr, "Out of bounds FSDEV write at %d\n", fsdev_ptr);
         }
@@ -131,6 +265,15 @@ static void io_write(int unused, uint16_t addr, uint8_t val)
             fsdev_ptr |= val;
             fsdev_addr_lvl = 0;
         }
+    } else if (addr == TIMER_PORT) {
+        if (timer_wlvl == 0) {
+            timer_latch = val;
+            timer_wlvl = 1;
+        } else {
+            timer_period = timer_latch | (val << 8);
+            timer_count = 0;
+            timer_wlvl = 0;
+        }
     } else {
         fprintf(stderr, "Out of bounds I/O write: %d / %d (0x%x)\n", addr, val, val);
     }
@@ -138,51 +281,118 @@ static void io_write(int unused, uint16_t addr, uint8_t val)
 
 static uint8_t mem_read(int unused, uint16_t addr)
 {
+    if ((addr >= AT28_START) && (addr < AT28_START+AT28_SIZE)) {
+        return at28_read(&at28, addr-AT28_START, cpu.tstates);
+    }
     return mem[addr];
 }
 
 static void mem_write(int unused, uint16_t addr, uint8_t val)
 {
+    if ((addr >= AT28_START) && (addr < AT28_START+AT28_SIZE)) {
+        at28_write(&at28, addr-AT28_START, val, cpu.tstates);
+        return;
+    }
     if (addr < RAMSTART) {
         fprintf(stderr, "Writing to ROM (%d)!\n", addr);
     }
     mem[addr] = val;
 }
 
-int main()
+// Called after each instruction, which took t T-states. was_req tells whether an
+// interrupt was requested before it.
+static void timer_step(unsigned t, int was_req)
+{
+    tstates += t;
+    if (in_int) {
+        int_tstates += t;
+        if (in_int == 2) {
+            in_int = 0; // that was the "reti"
+        } else if (cpu.IFF1) {
+            in_int = 2;
+        }
+    } else if (was_req && !cpu.int_req) {
+        // accepted
+        in_int = 1;
+        int_tstates += t;
+    }
+    if (timer_period) {
+        timer_count += t;
+        if (timer_count >= timer_period) {
+            timer_count -= timer_period;
+            timer_ticks++;
+            Z80INT(&cpu, 0);
+        }
+    }
+}
+
+static void timer_stats(FILE *fp)
+{
+    fprintf(fp, "Timer: %u ticks, %llu T-states, %llu in interrupts (%.2f%%)\n",
+        timer_ticks, (unsigned long long)tstates,
+        (unsigned long long)int_tstates, 100.0 * int_tstates / tstates);
+    fprintf(fp, "Timer: %llu T-states waiting for input, %u of %u fsdev writes "
+        "done meanwhile\n", (unsigned long long)stdin_wait_tstates,
+        fsdev_writes_waiting, fsdev_writes);
+}
+
+int main(int argc, char *argv[])
 {
+    int c;
+    cfsdir_init(&cfsdir);
+    while ((c = getopt(argc, argv, "d:")) != -1) {
+        if (c == 'd') {
+            if (cfsdir_add(&cfsdir, optarg, NULL) != 0) {
+                return 1;
+            }
+            use_cfsdir = 1;
+        } else {
+            fprintf(stderr, "Usage: shell [-d dir]\n");
+            return 1;
+        }
+    }
     // Setup fs blockdev
-    FILE *fp = popen("../cfspack/cfspack cfsin", "r");
-    if (fp != NULL) {
+    FILE *fp = NULL;
+    if (use_cfsdir) {
+        printf("Initializing filesystem from host files\n");
+        fsdev_size = cfsdir_size(&cfsdir);
+    } else if ((fp = popen("../cfspack/cfspack cfsin", "r")) != NULL) {
         printf("Initializing filesystem\n");
         int i = 0;
         int c = fgetc(fp);
-        while (c != EOF) {
+        while ((c != EOF) && (i < MAX_FSDEV_SIZE)) {
             fsdev[i] = c & 0xff;
             i++;
             c = fgetc(fp);
         }
         fsdev_size = i;
         pclose(fp);
+        if (c != EOF) {
+            fprintf(stderr, "cfsin is too big\n");
+            return 1;
+        }
     } else {
         printf("Can't initialize filesystem. Leaving blank.\n");
     }
 
-    // Turn echo off: the shell takes care of its own echoing.
+    // Turn echo off: the shell takes care of its own echoing. When stdin isn't
+    // a terminal (commands piped by a test), there's nothing to set up.
     struct termios termInfo;
-    if (tcgetattr(0, &termInfo) == -1) {
-        printf("Can't setup terminal.\n");
-        return 1;
+    int tty = tcgetattr(0, &termInfo) == 0;
+    if (tty) {
+        termInfo.c_lflag &= ~ECHO;
+        termInfo.c_lflag &= ~ICANON;
+        tcsetattr(0, TCSAFLUSH, &termInfo);
     }
-    termInfo.c_lflag &= ~ECHO;
-    termInfo.c_lflag &= ~ICANON;
-    tcsetattr(0, TCSAFLUSH, &termInfo);
+    // We poll stdin: nothing must wait in stdio's buffer.
+    setvbuf(stdin, NULL, _IONBF, 0);
 
 
     // initialize memory
     for (int i=0; i<sizeof(KERNEL); i++) {
         mem[i] = KERNEL[i];
     }
+    at28_init(&at28);
     // Run!
     running = 1;
     Z80RESET(&cpu);
@@ -192,12 +402,27 @@ int main()
     cpu.memWrite = mem_write;
 
     while (running && !cpu.halted) {
+        unsigned start = cpu.tstates;
+        int was_req = cpu.int_req;
         Z80Execute(&cpu);
+        timer_step(cpu.tstates - start, was_req);
     }
 
     printf("Done!\n");
-    termInfo.c_lflag |= ECHO;
-    termInfo.c_lflag |= ICANON;
-    tcsetattr(0, TCSAFLUSH, &termInfo);
+    if (use_cfsdir) {
+        cfsdir_sync(&cfsdir);
+        cfsdir_stats(&cfsdir, stderr);
+    }
+    if (at28.cycles) {
+        at28_stats(&at28, stderr);
+    }
+    if (timer_ticks) {
+        timer_stats(stderr);
+    }
+    if (tty) {
+        termInfo.c_lflag |= ECHO;
+        termInfo.c_lflag |= ICANON;
+        tcsetattr(0, TCSAFLUSH, &termInfo);
+    }
     return 0;
 }
@@ -0,0 +1,3 @@
+.equ	BLKCACHE_RAMSTART	BLOCKDEV_RAMEND
+.equ	BLKCACHE_COUNT		4
+.inc "blkcache.asm"
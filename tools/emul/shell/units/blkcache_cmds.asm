@@ -0,0 +1,2 @@
+.inc "err.h"
+.inc "blkcache_cmds.asm"
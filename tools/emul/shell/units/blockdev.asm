@@ -0,0 +1,8 @@
+.equ	BLOCKDEV_RAMSTART	RAMSTART
+.equ	BLOCKDEV_COUNT		4
+.inc "blockdev.asm"
+; List of devices
+.dw	blkcacheGetC, blkcachePutC	; over fsdev
+.dw	stdoutGetC, stdoutPutC
+.dw	stdinGetC, stdinPutC
+.dw	mmapGetC, mmapPutC
@@ -0,0 +1,2 @@
+.inc "err.h"
+.inc "blockdev_cmds.asm"
@@ -0,0 +1 @@
+.inc "core.asm"
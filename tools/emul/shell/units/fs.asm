@@ -0,0 +1,4 @@
+.inc "err.h"
+.equ	FS_RAMSTART	STDIO_RAMEND
+.equ	FS_HANDLE_COUNT	2
+.inc "fs.asm"
@@ -0,0 +1,2 @@
+.inc "err.h"
+.inc "fs_cmds.asm"
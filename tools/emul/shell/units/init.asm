@@ -0,0 +1,136 @@
+; Tick every 10ms at 4MHz
+.equ	TIMER_PERIOD	40000
+; Ticks between two background flushes of the block cache
+.equ	FLUSH_TICKS	2
+
+init:
+	di
+	; setup stack
+	ld	hl, KERNEL_RAMEND
+	ld	sp, hl
+	im	1
+	ld	hl, emulGetC
+	ld	de, emulPutC
+	call	stdioInit
+	call	fsInit
+	; fsdev is accessed through the block cache
+	call	blkcacheInit
+	ld	hl, .fsdev
+	ld	de, BLKCACHE_BLK
+	call	blkSet
+	ld	a, 0	; select cached fsdev
+	ld	de, BLOCKDEV_SEL
+	call	blkSel
+	call	fsOn
+	call	shellInit
+	ld	hl, pgmShellHook
+	ld	(SHELL_CMDHOOK), hl
+	call	schedInit
+	ld	hl, flushTask
+	call	schedSpawn
+	ld	hl, emulIdle
+	ld	(SHELL_LOOPHOOK), hl
+	ld	hl, TIMER_PERIOD
+	ld	a, l
+	out	(TIMER_PORT), a
+	ld	a, h
+	out	(TIMER_PORT), a
+	ei
+	jp	shellLoop
+
+.fsdev:
+	.dw	fsdevGetC, fsdevPutC
+
+; Shell loop hook, called while we wait for input. emulGetC does the yielding.
+emulIdle:
+	in	a, (STDIN_STATUS_PORT)
+	or	a
+	ret	z		; nothing typed
+	; A command is starting. Write dirty blocks back to fsdev and forget
+	; clean ones: with "shell -d", fsdev is backed by host files which can be
+	; edited between commands. When we were idle long enough, flushTask
+	; already did the writing. We only do it for the first character of a
+	; line so that the cache survives between keystrokes.
+	ld	a, (STDIO_BUFIDX)
+	or	a
+	ret	nz
+	jp	blkcacheDrop
+
+; Writes dirty blocks back to fsdev in the background, that is, when emulGetC
+; yields while the shell or an app waits for input.
+flushTask:
+	ld	hl, FLUSH_TICKS
+	call	schedSleep
+	call	blkcacheFlush
+	jr	flushTask
+
+; Yields when nothing is typed. Apps reading lines (ed, for example) poll us
+; through stdioReadLine and never call the shell's loop hook, so this is where
+; flushTask gets to run while they wait.
+emulGetC:
+	in	a, (STDIN_STATUS_PORT)
+	or	a
+	jr	nz, .read
+	call	schedYield
+	jp	unsetZ		; nothing typed
+.read:
+	in	a, (STDIO_PORT)
+	cp	a		; ensure Z
+	ret
+
+emulPutC:
+	out	(STDIO_PORT), a
+	ret
+
+fsdevGetC:
+	ld	a, e
+	out	(FS_ADDR_PORT), a
+	ld	a, h
+	out	(FS_ADDR_PORT), a
+	ld	a, l
+	out	(FS_ADDR_PORT), a
+	in	a, (FS_ADDR_PORT)
+	or	a
+	ret	nz
+	in	a, (FS_DATA_PORT)
+	cp	a		; ensure Z
+	ret
+
+fsdevPutC:
+	push	af
+	ld	a, e
+	out	(FS_ADDR_PORT), a
+	ld	a, h
+	out	(FS_ADDR_PORT), a
+	ld	a, l
+	out	(FS_ADDR_PORT), a
+	in	a, (FS_ADDR_PORT)
+	cp	2		; only A > 1 means error
+	jr	nc, .error	; A >= 2
+	pop	af
+	out	(FS_DATA_PORT), a
+	cp	a		; ensure Z
+	ret
+.error:
+	pop	af
+	jp	unsetZ		; returns
+
+.equ	STDOUT_HANDLE	FS_HANDLES
+
+stdoutGetC:
+	ld	ix, STDOUT_HANDLE
+	jp	fsGetC
+
+stdoutPutC:
+	ld	ix, STDOUT_HANDLE
+	jp	fsPutC
+
+.equ	STDIN_HANDLE	FS_HANDLES+FS_HANDLE_SIZE
+
+stdinGetC:
+	ld	ix, STDIN_HANDLE
+	jp	fsGetC
+
+stdinPutC:
+	ld	ix, STDIN_HANDLE
+	jp	fsPutC
@@ -0,0 +1,2 @@
+.equ	MMAP_START	0xe000
+.inc "mmap.asm"
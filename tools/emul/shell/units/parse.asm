@@ -0,0 +1 @@
+.inc "parse.asm"
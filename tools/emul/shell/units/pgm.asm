@@ -0,0 +1,6 @@
+.inc "err.h"
+.equ	PGM_RAMSTART		SHELL_RAMEND
+.equ	PGM_CODEADDR		USERCODE
+.inc "pgm.asm"
+
+;.out	PGM_RAMEND
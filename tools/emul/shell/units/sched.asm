@@ -0,0 +1,4 @@
+.equ	SCHED_RAMSTART	PGM_RAMEND
+.equ	SCHED_COUNT	2
+.equ	SCHED_STACKSIZE	0x40
+.inc "sched.asm"
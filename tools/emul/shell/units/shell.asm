@@ -0,0 +1,7 @@
+.inc "err.h"
+.equ	SHELL_RAMSTART		FS_RAMEND
+.equ	SHELL_EXTRA_CMD_COUNT	11
+.inc "shell.asm"
+.dw	blkBselCmd, blkSeekCmd, blkLoadCmd, blkSaveCmd
+.dw	fsOnCmd, flsCmd, fnewCmd, fdelCmd, fopnCmd
+.dw	blkcacheFlushCmd, blkcacheStatsCmd
@@ -0,0 +1,2 @@
+.equ	STDIO_RAMSTART	BLKCACHE_RAMEND
+.inc "stdio.asm"
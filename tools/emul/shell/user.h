@@ -1,4 +1,4 @@
-.equ    USER_CODE       0x4200
+.equ    USER_CODE       0x4800
 .equ    USER_RAMSTART   USER_CODE+0x1800
 .equ    FS_HANDLE_SIZE  8
 .equ    BLOCKDEV_SIZE   8
@@ -21,7 +21,8 @@
 .equ	fsOpen			@+3
 .equ	fsGetC			@+3
 .equ	fsPutC			@+3
-.equ	fsSetSize		@+3
+; 0x38 is the interrupt hook
+.equ	fsSetSize		0x3b
 .equ	cpHLDE			@+3
 .equ	parseArgs		@+3
 .equ	printstr		@+3
@@ -32,3 +33,4 @@
 .equ	printcrlf		@+3
 .equ	stdioPutC		@+3
 .equ	stdioReadLine	@+3
+.equ	blkGetC			@+3
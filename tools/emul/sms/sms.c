@@ -0,0 +1,397 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../libz80/z80.h"
+#include "../guard/guard.h"
+#include "vdp.h"
+
+/* Sega Master System, headless
+ *
+ * Runs a SMS ROM such as the ones from recipes/sms. Input is read from stdin
+ * and typed through one of the controller ports:
+ *
+ * - By default, as a MD pad on port A, for sms/pad.asm. Each character is
+ *   selected with the direction pad and confirmed with C. The last character
+ *   of a line is confirmed with Start, which also sends the line feed. Empty
+ *   lines can't be typed. BS (or DEL) presses A.
+ * - With -k, as the PS/2 adapter of recipe sms/kbd on port B, for sms/kbd.asm.
+ *   Characters are translated to set 2 scan codes.
+ *
+ * The ROM runs until it halts or until it has consumed all input and then
+ * polled its port IDLE_POLLS times without getting anything. The screen is
+ * then dumped to stdout as text (see vdp_dump()).
+ *
+ * Also takes guard options (-b, -t and -s, see guard/guard.h). With -s, VDP
+ * stats are also printed. Idle detection relies on the ROM polling the port we
+ * type on: a ROM reading the other one (a kbd ROM without -k, for example)
+ * would run forever, so the instruction budget defaults to DEFAULT_BUDGET
+ * rather than no limit. "-b 0" removes it.
+ *
+ * Memory layout:
+ *
+ * 0x0000 - 0xbfff: ROM (no mapper, so ROMs are limited to 48K)
+ * 0xc000 - 0xdfff: RAM, mirrored in 0xe000 - 0xffff
+ *
+ * I/O Ports (only A7, A6 and A0 are decoded, like on the real thing):
+ *
+ * 0x3f - I/O control: direction and level of TH/TR pins of both ports
+ * 0x7f - PSG, ignored
+ * 0xbe - VDP data
+ * 0xbf - VDP control
+ * 0xdc - Port A (and port B's up/down)
+ * 0xdd - Port B (and TH inputs)
+ */
+
+#define ROM_SIZE 0xc000
+#define RAMSTART 0xc000
+#define RAM_SIZE 0x2000
+// in sync with sms/pad.asm
+#define PAD_UP 0
+#define PAD_DOWN 1
+#define PAD_LEFT 2
+#define PAD_RIGHT 3
+#define PAD_BUTB 4
+#define PAD_BUTC 5
+#define PAD_BUTA 6
+#define PAD_START 7
+// Number of polls for which each pad state is held. A shell loop polls twice
+// (selection hook and GetC), so this makes both see every state.
+#define PAD_HOLD 4
+#define IDLE_POLLS 0x100
+#define MAX_INPUT 0x10000
+// About 30 seconds of host time. Much more than what typing stdin takes.
+#define DEFAULT_BUDGET 1000000000
+
+#define KC_BREAK 0xf0
+#define KC_LSHIFT 0x12
+
+static Z80Context cpu;
+static uint8_t rom[ROM_SIZE];
+static uint8_t ram[RAM_SIZE];
+static VDP vdp;
+static Guard guard;
+static int use_kbd = 0;
+// Last value written to the I/O control port. At reset, all pins are inputs.
+static uint8_t ioctl = 0xff;
+// Pad states (bits as in padStatus, low is pressed) or key codes to send.
+static uint8_t input[MAX_INPUT];
+static int input_len = 0;
+static int input_ptr = 0;
+static int polls = 0;
+static int idle = 0;
+// For kbd: whether the current key code is being read by the adapter
+static int kbd_fetching = 0;
+
+// in sync with kbdScanCodes and kbdScanCodesS in kbd.asm
+static const char scancodes[0x80] = {
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  9,'`',  0,
+    0,  0,  0,  0,  0,'q','1',  0,  0,  0,'z','s','a','w','2',  0,
+    0,'c','x','d','e','4','3',  0,  0,' ','v','f','t','r','5',  0,
+    0,'n','b','h','g','y','6',  0,  0,  0,'m','j','u','7','8',  0,
+    0,',','k','i','o','0','9',  0,  0,'.','/','l',';','p','-',  0,
+    0,  0,'\'', 0,'[','=',  0,  0,  0,  0, 13,']',  0,'\\', 0,  0,
+    0,  0,  0,  0,  0,  0,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0, 27,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+static const char scancodes_s[0x80] = {
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  9,'~',  0,
+    0,  0,  0,  0,  0,'Q','!',  0,  0,  0,'Z','S','A','W','@',  0,
+    0,'C','X','D','E','$','#',  0,  0,' ','V','F','T','R','%',  0,
+    0,'N','B','H','G','Y','^',  0,  0,  0,'M','J','U','&','*',  0,
+    0,'<','K','I','O',')','(',  0,  0,'>','?','L',':','P','_',  0,
+    0,  0,'"',  0,'{','+',  0,  0,  0,  0, 13,'}',  0,'|',  0,  0,
+    0,  0,  0,  0,  0,  0,  8,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0, 27,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+static void push_input(uint8_t val)
+{
+    if (input_len == MAX_INPUT) {
+        fprintf(stderr, "Input too long\n");
+        exit(1);
+    }
+    input[input_len++] = val;
+}
+
+// Selection change that a pad direction makes, as in padUpdateSel.
+static int pad_move(int c, int dir)
+{
+    static const int deltas[4] = {1, -1, -5, 5};
+    c += deltas[dir];
+    if (c >= 0x7f) {
+        return ' ';
+    }
+    if (c < 0x20) {
+        return '~';
+    }
+    return c;
+}
+
+static void push_press(int button)
+{
+    push_input(~(1 << button));
+    push_input(0xff);
+}
+
+// Pushes the shortest sequence of direction presses going from selected char
+// sel to char c.
+static void push_pad_select(int sel, int c)
+{
+    int prev[0x80];
+    int prevdir[0x80];
+    int queue[0x80];
+    int qlen = 0;
+    memset(prev, -1, sizeof(prev));
+    prev[sel] = sel;
+    queue[qlen++] = sel;
+    for (int i=0; i<qlen && prev[c] < 0; i++) {
+        for (int dir=PAD_UP; dir<=PAD_RIGHT; dir++) {
+            int next = pad_move(queue[i], dir);
+            if (prev[next] < 0) {
+                prev[next] = queue[i];
+                prevdir[next] = dir;
+                queue[qlen++] = next;
+            }
+        }
+    }
+    // Walk the path back, then push it in order.
+    int path[0x80];
+    int len = 0;
+    for (int i=c; i!=sel; i=prev[i]) {
+        path[len++] = prevdir[i];
+    }
+    while (len > 0) {
+        push_press(path[--len]);
+    }
+}
+
+static void read_pad_input()
+{
+    // in sync with padInit
+    int sel = 'a';
+    int c = getchar();
+    while (c != EOF) {
+        int next = getchar();
+        if ((c == 0x08) || (c == 0x7f)) {
+            push_press(PAD_BUTA);
+        } else if ((c >= 0x20) && (c < 0x7f)) {
+            push_pad_select(sel, c);
+            sel = c;
+            push_press(next == '\n' ? PAD_START : PAD_BUTC);
+        }
+        c = next;
+    }
+}
+
+static void push_key(uint8_t kc, int shift)
+{
+    if (shift) {
+        push_input(KC_LSHIFT);
+    }
+    push_input(kc);
+    push_input(KC_BREAK);
+    push_input(kc);
+    if (shift) {
+        push_input(KC_BREAK);
+        push_input(KC_LSHIFT);
+    }
+}
+
+static void read_kbd_input()
+{
+    int c;
+    while ((c = getchar()) != EOF) {
+        if (c == '\n') {
+            c = 13;
+        } else if (c == 0x7f) {
+            c = 8;
+        }
+        int found = 0;
+        for (int kc=0; kc<0x80 && !found; kc++) {
+            if (scancodes[kc] == c) {
+                push_key(kc, 0);
+                found = 1;
+            } else if (scancodes_s[kc] == c) {
+                push_key(kc, 1);
+                found = 1;
+            }
+        }
+    }
+}
+
+static void poll()
+{
+    if (input_ptr < input_len) {
+        return;
+    }
+    if (++idle >= IDLE_POLLS) {
+        guard.stop = 1;
+    }
+}
+
+static uint8_t port_a()
+{
+    uint8_t res = 0xff;
+    if (!use_kbd) {
+        uint8_t status = input_ptr < input_len ? input[input_ptr] : 0xff;
+        if ((ioctl & 0b00100010) == 0) {
+            // TH selected: Up and Down, then A and Start in TL and TR.
+            res = 0xc0 | (status & 0x03) | ((status >> 2) & 0x30);
+        } else {
+            res = 0xc0 | (status & 0x3f);
+            poll();
+            if ((input_ptr < input_len) && (++polls == PAD_HOLD)) {
+                polls = 0;
+                input_ptr++;
+            }
+        }
+    } else if (input_ptr < input_len) {
+        // Port B up/down are bits 1:0 or 5:4 of the key code
+        uint8_t kc = input[input_ptr];
+        if (ioctl & 0x80) {
+            kc >>= 4;
+        }
+        res = 0x3f | ((kc & 0x03) << 6);
+    }
+    return res;
+}
+
+static uint8_t port_b()
+{
+    // reset and cont pins always high, TH levels as set in I/O control
+    uint8_t res = 0x3c | (ioctl & 0x20 ? 0x40 : 0) | (ioctl & 0x80);
+    if (!use_kbd) {
+        return res | 0x03;
+    }
+    if (input_ptr < input_len) {
+        // TL low: a key code is ready. Port B left/right are bits 3:2 or
+        // 7:6 of it.
+        uint8_t kc = input[input_ptr];
+        if (ioctl & 0x80) {
+            kc >>= 4;
+        }
+        res = (res & ~0x04) | ((kc >> 2) & 0x03);
+    } else {
+        res |= 0x03;
+        poll();
+    }
+    return res;
+}
+
+static void set_ioctl(uint8_t val)
+{
+    ioctl = val;
+    if (!use_kbd || (input_ptr == input_len)) {
+        return;
+    }
+    if ((val & 0b10001000) == 0) {
+        // port B TH is output, low: the adapter is being read.
+        kbd_fetching = 1;
+    } else if ((val & 0b00001000) && kbd_fetching) {
+        // port B TH back to input: the adapter moves to the next code.
+        kbd_fetching = 0;
+        input_ptr++;
+    }
+}
+
+static uint8_t io_read(int unused, uint16_t addr)
+{
+    switch (addr & 0xc1) {
+    case 0x80:
+        return vdp_data_read(&vdp);
+    case 0x81:
+        return vdp_ctl_read(&vdp);
+    case 0xc0:
+        return port_a();
+    case 0xc1:
+        return port_b();
+    }
+    // V and H counters and unmapped ports
+    return 0xff;
+}
+
+static void io_write(int unused, uint16_t addr, uint8_t val)
+{
+    switch (addr & 0xc1) {
+    case 0x01:
+        set_ioctl(val);
+        break;
+    case 0x80:
+        vdp_data_write(&vdp, val);
+        break;
+    case 0x81:
+        vdp_ctl_write(&vdp, val);
+        break;
+    }
+    // memory control and PSG are ignored
+}
+
+static uint8_t mem_read(int unused, uint16_t addr)
+{
+    if (addr < RAMSTART) {
+        return rom[addr];
+    }
+    return ram[addr % RAM_SIZE];
+}
+
+static void mem_write(int unused, uint16_t addr, uint8_t val)
+{
+    if (addr < RAMSTART) {
+        // Writing to ROM does nothing
+        return;
+    }
+    ram[addr % RAM_SIZE] = val;
+}
+
+int main(int argc, char *argv[])
+{
+    guard_init(&guard);
+    guard.budget = DEFAULT_BUDGET;
+    int c;
+    while ((c = getopt(argc, argv, "kb:t:s")) != -1) {
+        if (c == 'k') {
+            use_kbd = 1;
+        } else if (!guard_opt(&guard, c, optarg)) {
+            fprintf(stderr, "Usage: sms [-k] [-b budget] [-t secs] [-s] rom.sms < input\n");
+            return 1;
+        }
+    }
+    if (optind != argc-1) {
+        fprintf(stderr, "Usage: sms [-k] [-b budget] [-t secs] [-s] rom.sms < input\n");
+        return 1;
+    }
+    FILE *fp = fopen(argv[optind], "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open %s\n", argv[optind]);
+        return 1;
+    }
+    size_t romsize = fread(rom, 1, ROM_SIZE, fp);
+    if (fgetc(fp) != EOF) {
+        fprintf(stderr, "ROM bigger than 48K, truncated\n");
+    }
+    fclose(fp);
+    if (!romsize) {
+        fprintf(stderr, "Empty ROM, aborting\n");
+        return 1;
+    }
+    if (use_kbd) {
+        read_kbd_input();
+    } else {
+        read_pad_input();
+    }
+    vdp_init(&vdp);
+    Z80RESET(&cpu);
+    cpu.ioRead = io_read;
+    cpu.ioWrite = io_write;
+    cpu.memRead = mem_read;
+    cpu.memWrite = mem_write;
+
+    int res = guard_run(&guard, &cpu);
+    vdp_dump(&vdp, stdout);
+    if (guard.stats) {
+        vdp_stats(&vdp, stderr);
+    }
+    return res;
+}
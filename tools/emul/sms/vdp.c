@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include "vdp.h"
+
+// in sync with the font in sms/vdp.asm
+#define FONT_FIRST_CHAR 0x20
+#define FONT_CHAR_COUNT 0x5f
+
+void vdp_init(VDP *vdp)
+{
+    memset(vdp, 0, sizeof(VDP));
+}
+
+uint8_t vdp_ctl_read(VDP *vdp)
+{
+    // We have no frame or line interrupt to report, but reading status still
+    // resets the command word.
+    vdp->haslatch = 0;
+    return 0;
+}
+
+void vdp_ctl_write(VDP *vdp, uint8_t val)
+{
+    vdp->ctlwrites++;
+    if (!vdp->haslatch) {
+        vdp->latch = val;
+        vdp->haslatch = 1;
+        return;
+    }
+    vdp->haslatch = 0;
+    vdp->code = val >> 6;
+    vdp->addr = ((val & 0x3f) << 8) | vdp->latch;
+    if (vdp->code == 0) {
+        // VRAM read: the read buffer is filled right away.
+        vdp->readbuf = vdp->vram[vdp->addr];
+        vdp->addr = (vdp->addr + 1) % VDP_VRAM_SIZE;
+    } else if (vdp->code == 2) {
+        uint8_t reg = val & 0xf;
+        vdp->regs[reg] = vdp->latch;
+        if (reg == 9) {
+            vdp->scrolls++;
+        }
+    }
+}
+
+uint8_t vdp_data_read(VDP *vdp)
+{
+    vdp->haslatch = 0;
+    uint8_t res = vdp->readbuf;
+    vdp->readbuf = vdp->vram[vdp->addr];
+    vdp->addr = (vdp->addr + 1) % VDP_VRAM_SIZE;
+    return res;
+}
+
+void vdp_data_write(VDP *vdp, uint8_t val)
+{
+    vdp->haslatch = 0;
+    vdp->datawrites++;
+    if (vdp->code == 3) {
+        vdp->cram[vdp->addr % VDP_CRAM_SIZE] = val;
+    } else {
+        vdp->vram[vdp->addr] = val;
+    }
+    vdp->readbuf = val;
+    vdp->addr = (vdp->addr + 1) % VDP_VRAM_SIZE;
+}
+
+void vdp_dump(VDP *vdp, FILE *fp)
+{
+    unsigned nt = (vdp->regs[2] & 0x0e) << 10;
+    unsigned vscroll = vdp->regs[9];
+    for (int row=0; row<VDP_ROWS; row++) {
+        char line[VDP_COLS+1];
+        unsigned ntrow = ((row * 8 + vscroll) % (VDP_NT_ROWS * 8)) / 8;
+        uint8_t *cell = &vdp->vram[nt + ntrow * VDP_COLS * 2];
+        int len = 0;
+        for (int col=0; col<VDP_COLS; col++) {
+            unsigned tile = cell[col*2] | ((cell[col*2+1] & 1) << 8);
+            char c = '?';
+            if (tile < FONT_CHAR_COUNT) {
+                c = tile + FONT_FIRST_CHAR;
+            }
+            line[col] = c;
+            if (c != ' ') {
+                len = col + 1;
+            }
+        }
+        line[len] = '\0';
+        fprintf(fp, "%s\n", line);
+    }
+}
+
+void vdp_stats(VDP *vdp, FILE *fp)
+{
+    fprintf(fp, "VDP: %u data writes, %u control writes, %u scrolls\n",
+        vdp->datawrites, vdp->ctlwrites, vdp->scrolls);
+}
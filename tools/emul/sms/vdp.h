@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include <stdio.h>
+
+/* Sega Master System VDP model
+ *
+ * Models what a text console needs from the VDP (the TMS9918 derivative in
+ * the SMS):
+ *
+ * - Control port: two writes make a command word. The two high bits of the
+ *   second byte select between VRAM read, VRAM write, register write and
+ *   CRAM write. Other bits are the address (or, for register writes, the
+ *   register number).
+ * - Data port: reads and writes VRAM (or CRAM) at the current address, which
+ *   then auto-increments. Reads are buffered, like on the real chip.
+ * - Registers: only 2 (name table base) and 9 (vertical scroll) affect what
+ *   vdp_dump() shows.
+ *
+ * Timing (VRAM access slots, interrupts, line counters) isn't modeled.
+ */
+
+#define VDP_VRAM_SIZE 0x4000
+#define VDP_CRAM_SIZE 0x20
+#define VDP_COLS 32
+// Visible rows on screen
+#define VDP_ROWS 24
+// Rows in the name table. The 4 rows that aren't visible can be scrolled in.
+#define VDP_NT_ROWS 28
+
+typedef struct {
+    uint8_t vram[VDP_VRAM_SIZE];
+    uint8_t cram[VDP_CRAM_SIZE];
+    uint8_t regs[0x10];
+    uint16_t addr;
+    // 0 = VRAM read, 1 = VRAM write, 2 = register write, 3 = CRAM write
+    uint8_t code;
+    // first byte of a command word, when haslatch is set
+    uint8_t latch;
+    int haslatch;
+    uint8_t readbuf;
+    // Stats
+    unsigned datawrites;    // bytes written to the data port
+    unsigned ctlwrites;     // bytes written to the control port
+    unsigned scrolls;       // writes to the vertical scroll register
+} VDP;
+
+void vdp_init(VDP *vdp);
+uint8_t vdp_ctl_read(VDP *vdp);
+void vdp_ctl_write(VDP *vdp, uint8_t val);
+uint8_t vdp_data_read(VDP *vdp);
+void vdp_data_write(VDP *vdp, uint8_t val);
+// Prints visible rows as text, one line per row. Tiles are converted to ASCII
+// with the same mapping as sms/vdp.asm's font (tile 0 is ' ').
+void vdp_dump(VDP *vdp, FILE *fp);
+void vdp_stats(VDP *vdp, FILE *fp);
@@ -6,6 +6,7 @@
 .equ FS_DATA_PORT	0x02
 .equ FS_SEEK_PORT	0x03
 .equ STDERR_PORT	0x04
+.equ REPORT_PORT	0x05
 
 jp     init    ; 3 bytes
 ; *** JUMP TABLE ***
@@ -37,12 +38,13 @@ jp	printstr
 .inc "err.h"
 .inc "parse.asm"
 .equ	BLOCKDEV_RAMSTART	RAMSTART
-.equ	BLOCKDEV_COUNT		3
+.equ	BLOCKDEV_COUNT		4
 .inc "blockdev.asm"
 ; List of devices
 .dw	emulGetC, unsetZ
 .dw	unsetZ, emulPutC
 .dw	fsdevGetC, fsdevPutC
+.dw	unsetZ, reportPutC
 
 .equ	STDIO_RAMSTART	BLOCKDEV_RAMEND
 .inc "stdio.asm"
@@ -62,12 +64,21 @@ init:
 	ld	de, BLOCKDEV_SEL
 	call	blkSel
 	call	fsOn
+	; Only pass the report blkdev when the emulator wants a report: writing
+	; it isn't free.
 	ld	hl, .zasmArgs
+	in	a, (REPORT_PORT)
+	or	a
+	jr	nz, .call
+	ld	hl, .zasmArgsNoReport
+.call:
 	call	USER_CODE
 	; signal the emulator we're done
 	halt
 
 .zasmArgs:
+	.db	"0 1 3", 0
+.zasmArgsNoReport:
 	.db	"0 1", 0
 
 ; *** I/O ***
@@ -97,6 +108,11 @@ stderrPutC:
 	cp	a		; ensure Z
 	ret
 
+reportPutC:
+	out	(REPORT_PORT), a
+	cp	a		; ensure Z
+	ret
+
 fsdevGetC:
 	ld	a, e
 	out	(FS_SEEK_PORT), a
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "report.h"
+
+#define MAX_NAME_LEN 0x40
+#define RAMSTART_SUFFIX "_RAMSTART"
+#define RAMEND_SUFFIX "_RAMEND"
+
+typedef struct {
+    char name[MAX_NAME_LEN];
+    unsigned val;
+} Sym;
+
+static int symcmp(const void *a, const void *b)
+{
+    const Sym *sa = a;
+    const Sym *sb = b;
+    if (sa->val != sb->val) {
+        return sa->val < sb->val ? -1 : 1;
+    }
+    return strcmp(sa->name, sb->name);
+}
+
+// Returns a pointer to the constant named prefix+suffix, NULL if there's none.
+static Sym* findconst(Sym *consts, int count, char *prefix, int prefixlen,
+    char *suffix)
+{
+    for (int i=0; i<count; i++) {
+        char *name = consts[i].name;
+        if ((strncmp(name, prefix, prefixlen) == 0) &&
+                (strcmp(name+prefixlen, suffix) == 0)) {
+            return &consts[i];
+        }
+    }
+    return NULL;
+}
+
+void report_init(Report *r)
+{
+    memset(r, 0, sizeof(Report));
+}
+
+void report_putc(Report *r, uint8_t c)
+{
+    if (r->len == r->size) {
+        r->size = r->size ? r->size * 2 : 0x1000;
+        r->buf = realloc(r->buf, r->size + 1);
+    }
+    r->buf[r->len++] = c;
+}
+
+int report_write(Report *r, FILE *fp)
+{
+    if (r->len == 0) {
+        return 1;
+    }
+    r->buf[r->len] = 0;
+    Sym *labels = calloc(r->len, sizeof(Sym));
+    Sym *consts = calloc(r->len, sizeof(Sym));
+    int lcount = 0;
+    int ccount = 0;
+    int ended = 0;
+    unsigned endpc = 0;
+    // Include being read, its start PC in incpc
+    char incname[MAX_NAME_LEN] = {0};
+    unsigned incpc = 0;
+    int res = 0;
+    char *line = strtok(r->buf, "\n");
+    while (line != NULL) {
+        char name[MAX_NAME_LEN];
+        unsigned val;
+        if (sscanf(line, "I %63s %x", name, &val) == 2) {
+            strcpy(incname, name);
+            incpc = val;
+        } else if (sscanf(line, "E %x", &val) == 1) {
+            fprintf(fp, "inc\t%s\t0x%04x\t%u\n", incname, incpc, val - incpc);
+        } else if (sscanf(line, "L %63s %x", name, &val) == 2) {
+            strcpy(labels[lcount].name, name);
+            labels[lcount++].val = val;
+        } else if (sscanf(line, "C %63s %x", name, &val) == 2) {
+            strcpy(consts[ccount].name, name);
+            consts[ccount++].val = val;
+        } else if (sscanf(line, "P %x", &val) == 1) {
+            endpc = val;
+            ended = 1;
+        } else {
+            fprintf(stderr, "Bad report line: %s\n", line);
+            res = 1;
+        }
+        line = strtok(NULL, "\n");
+    }
+    if (!ended) {
+        fprintf(stderr, "Incomplete report\n");
+        res = 1;
+    }
+    qsort(labels, lcount, sizeof(Sym), symcmp);
+    for (int i=0; i<lcount; i++) {
+        unsigned next = (i+1 < lcount) ? labels[i+1].val : endpc;
+        unsigned bytes = next > labels[i].val ? next - labels[i].val : 0;
+        fprintf(fp, "label\t%s\t0x%04x\t%u\n", labels[i].name, labels[i].val, bytes);
+    }
+    qsort(consts, ccount, sizeof(Sym), symcmp);
+    for (int i=0; i<ccount; i++) {
+        char *name = consts[i].name;
+        char *suffix = strstr(name, RAMSTART_SUFFIX);
+        if ((suffix == NULL) || (strcmp(suffix, RAMSTART_SUFFIX) != 0)) {
+            continue;
+        }
+        int prefixlen = suffix - name;
+        Sym *end = findconst(consts, ccount, name, prefixlen, RAMEND_SUFFIX);
+        if (end == NULL) {
+            continue;
+        }
+        unsigned start = consts[i].val;
+        fprintf(fp, "ram\t%.*s\t0x%04x\t0x%04x\t%u\n", prefixlen, name, start,
+            end->val, end->val > start ? end->val - start : 0);
+    }
+    fprintf(fp, "end\t0x%04x\n", endpc);
+    free(labels);
+    free(consts);
+    return res;
+}
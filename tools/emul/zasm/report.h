@@ -0,0 +1,30 @@
+#include <stdint.h>
+#include <stdio.h>
+
+/* zasm report
+ *
+ * Collects the raw report zasm writes in its report blkdev (see
+ * apps/zasm/report.asm) and turns it into tab separated lines:
+ *
+ * inc    <name> <start> <bytes>        bytes emitted by each include
+ * label  <name> <addr> <bytes>         bytes from each global label to the
+ *                                      next one, by address
+ * ram    <prefix> <start> <end> <bytes>  RAM used by each unit, from its
+ *                                      <prefix>_RAMSTART and <prefix>_RAMEND
+ *                                      constants, by address
+ * end    <pc>                          PC at the end of assembling
+ *
+ * Addresses are 0x-prefixed hex, byte counts are decimal. tools/zasmdiff.sh
+ * compares two of those reports.
+ */
+
+typedef struct {
+    char *buf;
+    int len;
+    int size;
+} Report;
+
+void report_init(Report *r);
+void report_putc(Report *r, uint8_t c);
+// Returns 0 on success, 1 if the raw report is malformed or incomplete.
+int report_write(Report *r, FILE *fp);
@@ -1,6 +1,10 @@
 #include <stdint.h>
 #include <stdio.h>
+#include <unistd.h>
 #include "../libz80/z80.h"
+#include "../guard/guard.h"
+#include "../cfsdir/cfsdir.h"
+#include "report.h"
 #include "kernel-bin.h"
 #include "zasm-bin.h"
 
@@ -9,7 +13,15 @@
  * as those specified blkdevs.
  *
  * This executable takes one argument: the path to a .cfs file to use for
- * includes.
+ * includes. With -i, arguments are instead paths to directories (or single
+ * files) whose .h and .asm files are served as includes through cfsdir (see
+ * cfsdir/cfsdir.h), without packing them first. Includes are read-only and,
+ * like with cfspack -c, compressed.
+ * It also takes guard options (-b, -t and -s, see guard/guard.h).
+ *
+ * With "-r file", a report of what was assembled (see report.h) is written in
+ * file.
+ * When a guard limit is reached, exit code is GUARD_EXIT_CODE.
  *
  * Because the input blkdev needs support for Seek, we buffer it in the emulator
  * layer.
@@ -25,6 +37,11 @@
  *
  * 0 - stdin / stdout
  * 1 - When written to, rewind stdin buffer to the beginning.
+ * 2 - Includes CFS data
+ * 3 - Includes CFS address (24bit, MSB first)
+ * 4 - stderr
+ * 5 - zasm's report (see apps/zasm/report.asm). Reading it returns 1 if a
+ *     report was asked for, 0 otherwise.
  */
 
 // in sync with zasm_glue.asm
@@ -34,6 +51,7 @@
 #define FS_DATA_PORT 0x02
 #define FS_SEEK_PORT 0x03
 #define STDERR_PORT 0x04
+#define REPORT_PORT 0x05
 
 // Other consts
 #define STDIN_BUFSIZE 0x8000
@@ -45,6 +63,7 @@
 //#define VERBOSE
 
 static Z80Context cpu;
+static Guard guard;
 static uint8_t mem[0x10000];
 // STDIN buffer, allows us to seek and tell
 static uint8_t inpt[STDIN_BUFSIZE];
@@ -52,10 +71,16 @@ static int inpt_size;
 static int inpt_ptr;
 static uint8_t middle_of_seek_tell = 0;
 
-static uint8_t fsdev[0x40000] = {0};
+#define MAX_FSDEV_SIZE 0x100000
+static uint8_t fsdev[MAX_FSDEV_SIZE] = {0};
 static uint32_t fsdev_size = 0;
 static uint32_t fsdev_ptr = 0;
 static uint8_t fsdev_seek_tell_cnt = 0;
+// When set, includes are served by cfsdir instead of the fsdev array.
+static int use_cfsdir = 0;
+static CFSDir cfsdir;
+static Report report;
+static char *report_path = NULL;
 
 static uint8_t io_read(int unused, uint16_t addr)
 {
@@ -79,6 +104,9 @@ static uint8_t io_read(int unused, uint16_t addr)
         }
     } else if (addr == FS_DATA_PORT) {
         if (fsdev_ptr < fsdev_size) {
+            if (use_cfsdir) {
+                return cfsdir_read(&cfsdir, fsdev_ptr++) & 0xff;
+            }
             return fsdev[fsdev_ptr++];
         } else {
             return 0;
@@ -91,6 +119,8 @@ static uint8_t io_read(int unused, uint16_t addr)
         } else {
             return 0;
         }
+    } else if (addr == REPORT_PORT) {
+        return report_path != NULL;
     } else {
         fprintf(stderr, "Out of bounds I/O read: %d\n", addr);
         return 0;
@@ -118,7 +148,11 @@ static void io_write(int unused, uint16_t addr, uint8_t val)
         }
     } else if (addr == FS_DATA_PORT) {
         if (fsdev_ptr < fsdev_size) {
-            fsdev[fsdev_ptr++] = val;
+            // Host files are never written to.
+            if (!use_cfsdir) {
+                fsdev[fsdev_ptr] = val;
+            }
+            fsdev_ptr++;
         }
     } else if (addr == FS_SEEK_PORT) {
         if (fsdev_seek_tell_cnt == 0) {
@@ -138,6 +172,10 @@ static void io_write(int unused, uint16_t addr, uint8_t val)
 #ifdef VERBOSE
         fputc(val, stderr);
 #endif
+    } else if (addr == REPORT_PORT) {
+        if (report_path != NULL) {
+            report_putc(&report, val);
+        }
     } else {
         fprintf(stderr, "Out of bounds I/O write: %d / %d (0x%x)\n", addr, val, val);
     }
@@ -155,7 +193,23 @@ static void mem_write(int unused, uint16_t addr, uint8_t val)
 
 int main(int argc, char *argv[])
 {
-    if (argc > 2) {
+    guard_init(&guard);
+    report_init(&report);
+    int c;
+    while ((c = getopt(argc, argv, "b:t:sir:")) != -1) {
+        if (c == 'i') {
+            use_cfsdir = 1;
+        } else if (c == 'r') {
+            report_path = optarg;
+        } else if (!guard_opt(&guard, c, optarg)) {
+            fprintf(stderr, "Usage: zasm [-b budget] [-t secs] [-s] [-r report] [file.cfs]\n");
+            fprintf(stderr, "       zasm [-b budget] [-t secs] [-s] [-r report] -i path...\n");
+            return 1;
+        }
+    }
+    argc -= optind-1;
+    argv += optind-1;
+    if ((argc > 2) && !use_cfsdir) {
         fprintf(stderr, "Too many args\n");
         return 1;
     }
@@ -167,24 +221,39 @@ int main(int argc, char *argv[])
         mem[i+USER_CODE] = USERSPACE[i];
     }
     fsdev_size = 0;
-    if (argc == 2) {
+    if (use_cfsdir) {
+        cfsdir_init(&cfsdir);
+        cfsdir.compress = 1;
+        for (int i=1; i<argc; i++) {
+            // Same order as a zasm.sh-packed CFS.
+            if ((cfsdir_add(&cfsdir, argv[i], "*.h") != 0) ||
+                    (cfsdir_add(&cfsdir, argv[i], "*.asm") != 0)) {
+                return 1;
+            }
+        }
+        fsdev_size = cfsdir_size(&cfsdir);
+    } else if (argc == 2) {
         FILE *fp = fopen(argv[1], "r");
         if (fp == NULL) {
             fprintf(stderr, "Can't open file %s\n", argv[1]);
             return 1;
         }
-        int c = fgetc(fp);
-        while (c != EOF) {
+        c = fgetc(fp);
+        while ((c != EOF) && (fsdev_size < MAX_FSDEV_SIZE)) {
             fsdev[fsdev_size] = c;
             fsdev_size++;
             c = fgetc(fp);
         }
         fclose(fp);
+        if (c != EOF) {
+            fprintf(stderr, "%s is too big\n", argv[1]);
+            return 1;
+        }
     }
     // read stdin in buffer
     inpt_size = 0;
     inpt_ptr = 0;
-    int c = getchar();
+    c = getchar();
     while (c != EOF) {
         inpt[inpt_ptr] = c & 0xff;
         inpt_ptr++;
@@ -201,8 +270,8 @@ int main(int argc, char *argv[])
     cpu.memRead = mem_read;
     cpu.memWrite = mem_write;
 
-    while (!cpu.halted) {
-        Z80Execute(&cpu);
+    if (guard_run(&guard, &cpu) != 0) {
+        return GUARD_EXIT_CODE;
     }
 #ifdef MEMDUMP
     for (int i=0; i<0x10000; i++) {
@@ -224,6 +293,16 @@ int main(int argc, char *argv[])
         } else {
             fprintf(stderr, "Error %d on line %d\n", res, lineno);
         }
+    } else if (report_path != NULL) {
+        FILE *fp = fopen(report_path, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "Can't open %s\n", report_path);
+            return 1;
+        }
+        if (report_write(&report, fp) != 0) {
+            res = 1;
+        }
+        fclose(fp);
     }
     return res;
 }
@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+
+set -e
+
+# Runs at28w against the emulated AT28 and checks that it writes in pages.
+
+BASE=../../..
+TOOLS=../..
+ZASM="${TOOLS}/zasm.sh"
+RUNBIN="${TOOLS}/emul/runbin/runbin"
+KERNEL="${BASE}/kernel"
+APPS="${BASE}/apps"
+
+echo "Running at28w test"
+STATS=$(${ZASM} "${KERNEL}" "${APPS}" < test.asm | ${RUNBIN} -a 2>&1) || {
+    echo "failed with code $?"
+    exit 1
+}
+echo "${STATS}"
+# 300 bytes is 4 full pages and one partial page
+if [[ "${STATS}" != "AT28: 300 bytes in 5 write cycles"* ]]; then
+    echo "unexpected write cycles"
+    exit 1
+fi
+
+echo "All tests passed!"
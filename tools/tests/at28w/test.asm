@@ -0,0 +1,41 @@
+; Writes 300 bytes to the emulated AT28 with at28w. Data comes from a fake
+; blkGetC that returns (i*7) & 0xff for each byte i.
+.equ	RAMSTART	0x4000
+.equ	AT28W_RAMSTART	RAMSTART+2
+.equ	TEST_DATAPTR	RAMSTART
+
+jp	test
+
+.inc "core.asm"
+.inc "err.h"
+.inc "at28w/main.asm"
+
+blkGetC:
+	push	hl
+	ld	hl, (TEST_DATAPTR)
+	ld	a, l
+	add	a, a	; *2
+	add	a, a	; *4
+	add	a, a	; *8
+	sub	l	; *7
+	inc	hl
+	ld	(TEST_DATAPTR), hl
+	pop	hl
+	cp	a		; ensure Z
+	ret
+
+; unused
+parseArgs:
+	jp	unsetZ
+
+test:
+	ld	sp, 0xffff
+	ld	hl, 0
+	ld	(TEST_DATAPTR), hl
+	; Words in parseArgs aren't little endian. 300 == 0x012c
+	ld	a, 0x01
+	ld	(AT28W_MAXBYTES), a
+	ld	a, 0x2c
+	ld	(AT28W_MAXBYTES+1), a
+	call	at28wInner
+	halt
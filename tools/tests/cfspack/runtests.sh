@@ -0,0 +1,128 @@
+#!/usr/bin/env bash
+
+set -e
+
+# Checks the metadata cfspack writes for names at the length limit.
+
+CFSPACK=../../cfspack/cfspack
+CFSUNPACK=../../cfspack/cfsunpack
+
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "${TMPDIR}"' EXIT
+
+# Byte at offset $2 of file $1, in hex
+byteat() {
+    xxd -s $2 -l 1 -p "$1"
+}
+
+NAME24=abcdefghijklmnopqrstuvwx
+NAME25=${NAME24}y
+
+echo "24 chars name"
+mkdir "${TMPDIR}/ok"
+# compressible, so that the flags byte isn't zero
+printf 'aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa' > "${TMPDIR}/ok/${NAME24}"
+"${CFSPACK}" -c "${TMPDIR}/ok" > "${TMPDIR}/ok.cfs"
+if [ "$(head -c 30 "${TMPDIR}/ok.cfs" | tail -c 24)" != "${NAME24}" ]; then
+    echo "name not written"
+    exit 1
+fi
+if [ "$(byteat "${TMPDIR}/ok.cfs" 30)" != "00" ]; then
+    echo "name not null terminated"
+    exit 1
+fi
+if [ "$(byteat "${TMPDIR}/ok.cfs" 31)" != "01" ]; then
+    echo "wrong flags"
+    exit 1
+fi
+
+echo "25 chars name"
+mkdir "${TMPDIR}/long"
+echo foo > "${TMPDIR}/long/${NAME25}"
+if "${CFSPACK}" "${TMPDIR}/long" > /dev/null 2>&1; then
+    echo "name too long accepted"
+    exit 1
+fi
+if "${CFSPACK}" "${TMPDIR}/long/${NAME25}" > /dev/null 2>&1; then
+    echo "name too long accepted"
+    exit 1
+fi
+
+# The "/" of subdirectories counts
+echo "24 chars path"
+mkdir -p "${TMPDIR}/sub/abc"
+echo foo > "${TMPDIR}/sub/abc/${NAME24:4}"
+"${CFSPACK}" "${TMPDIR}/sub" > /dev/null
+echo foo > "${TMPDIR}/sub/abc/${NAME24:3}"
+if "${CFSPACK}" "${TMPDIR}/sub" > /dev/null 2>&1; then
+    echo "path too long accepted"
+    exit 1
+fi
+
+# Packs directory $1 with cfspack options $2, unpacks it and compares
+roundtrip() {
+    rm -rf "${TMPDIR}/out"
+    mkdir "${TMPDIR}/out"
+    "${CFSPACK}" $2 "$1" > "${TMPDIR}/rt.cfs"
+    "${CFSUNPACK}" "${TMPDIR}/out" < "${TMPDIR}/rt.cfs"
+    if ! diff -r "$1" "${TMPDIR}/out"; then
+        echo "round trip mismatch"
+        exit 1
+    fi
+}
+
+mkdir "${TMPDIR}/rt"
+# compressible, and more than one chunk
+for i in $(seq 300); do echo "line $i"; done > "${TMPDIR}/rt/text"
+# not compressible
+head -c 1000 /dev/urandom > "${TMPDIR}/rt/random"
+echo foo > "${TMPDIR}/rt/small"
+
+echo "round trip"
+roundtrip "${TMPDIR}/rt"
+
+echo "round trip, compressed"
+roundtrip "${TMPDIR}/rt" -c
+
+echo "round trip, large files"
+mkdir "${TMPDIR}/large"
+head -c $((0xfee1)) /dev/urandom > "${TMPDIR}/large/justover"
+head -c $((0x12345)) /dev/urandom > "${TMPDIR}/large/big"
+for i in $(seq 10000); do echo "line $i"; done > "${TMPDIR}/large/bigtext"
+roundtrip "${TMPDIR}/large"
+roundtrip "${TMPDIR}/large" -c
+
+echo "compressed file"
+"${CFSPACK}" -c "${TMPDIR}/rt/text" > "${TMPDIR}/rt.cfs"
+if [ "$(byteat "${TMPDIR}/rt.cfs" 31)" != "01" ]; then
+    echo "text not compressed"
+    exit 1
+fi
+
+echo "literals past the end of data"
+# Point the last chunk, 32 bytes, to a literal token in the last byte of data
+SIZE=$(stat -c %s "${TMPDIR}/rt.cfs")
+DATALEN=$((SIZE - 0x20))
+cp "${TMPDIR}/rt.cfs" "${TMPDIR}/bad.cfs"
+printf "\\x$(printf %02x $(((DATALEN - 1) & 0xff)))\\x$(printf %02x $(((DATALEN - 1) >> 8)))" \
+    | dd of="${TMPDIR}/bad.cfs" bs=1 seek=$((0x20 + 10 * 2)) conv=notrunc 2> /dev/null
+printf '\x7f' | dd of="${TMPDIR}/bad.cfs" bs=1 seek=$((SIZE - 1)) conv=notrunc 2> /dev/null
+rm -rf "${TMPDIR}/out"
+mkdir "${TMPDIR}/out"
+if "${CFSUNPACK}" "${TMPDIR}/out" < "${TMPDIR}/bad.cfs"; then
+    echo "literals past the end accepted"
+    exit 1
+fi
+
+echo "bogus block count"
+# A compressed file claiming 0xffff blocks
+cp "${TMPDIR}/rt.cfs" "${TMPDIR}/bogus.cfs"
+printf '\xff' | dd of="${TMPDIR}/bogus.cfs" bs=1 seek=3 conv=notrunc 2> /dev/null
+printf '\x03' | dd of="${TMPDIR}/bogus.cfs" bs=1 seek=31 conv=notrunc 2> /dev/null
+printf '\xff' | dd of="${TMPDIR}/bogus.cfs" bs=1 seek=29 conv=notrunc 2> /dev/null
+if "${CFSUNPACK}" "${TMPDIR}/out" < "${TMPDIR}/bogus.cfs"; then
+    echo "bogus block count accepted"
+    exit 1
+fi
+
+echo "All tests passed!"
@@ -0,0 +1,6 @@
+.equ	FOO_RAMEND	FOO_RAMSTART+0x10
+foo:
+	ld	a, 1
+	ret
+bar:
+	.db	1, 2, 3, 4
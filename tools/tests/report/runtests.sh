@@ -0,0 +1,75 @@
+#!/usr/bin/env bash
+
+set -e
+
+# Checks the report written by "zasm -r" for test.asm and what zasmdiff.sh
+# prints when a build of it changes.
+
+ZASM=../../zasm.sh
+ZASMDIFF=../../zasmdiff.sh
+
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "${TMPDIR}"' EXIT
+
+TAB=$'\t'
+
+# Fails unless report $1 has line $2
+expectline() {
+    if ! grep -qxF "$2" "$1"; then
+        echo "missing line in $(basename "$1"): $2"
+        cat "$1"
+        exit 1
+    fi
+}
+
+echo "report"
+"${ZASM}" -r "${TMPDIR}/old.report" . < test.asm > /dev/null
+expectline "${TMPDIR}/old.report" "inc${TAB}foo.asm${TAB}0x0003${TAB}7"
+expectline "${TMPDIR}/old.report" "label${TAB}foo${TAB}0x0003${TAB}3"
+expectline "${TMPDIR}/old.report" "label${TAB}bar${TAB}0x0006${TAB}4"
+expectline "${TMPDIR}/old.report" "label${TAB}start${TAB}0x000a${TAB}1"
+expectline "${TMPDIR}/old.report" "ram${TAB}FOO${TAB}0x8000${TAB}0x8010${TAB}16"
+expectline "${TMPDIR}/old.report" "end${TAB}0x000b"
+if [ "$(wc -l < "${TMPDIR}/old.report")" -ne 6 ]; then
+    echo "unexpected lines in report"
+    cat "${TMPDIR}/old.report"
+    exit 1
+fi
+
+echo "no report without -r"
+"${ZASM}" . < test.asm > "${TMPDIR}/noreport.bin"
+"${ZASM}" -r "${TMPDIR}/unused.report" . < test.asm > "${TMPDIR}/report.bin"
+if ! cmp -s "${TMPDIR}/noreport.bin" "${TMPDIR}/report.bin"; then
+    echo "-r changes the assembled binary"
+    exit 1
+fi
+
+echo "zasmdiff"
+# foo grows by a byte, bar goes away and RAM grows by 0x10.
+mkdir "${TMPDIR}/new"
+cp test.asm "${TMPDIR}/new"
+sed -e 's/^\tret$/\tnop\n\tret/' -e '/^bar:$/d' -e '/\.db/d' \
+    -e 's/+0x10$/+0x20/' foo.asm > "${TMPDIR}/new/foo.asm"
+"${ZASM}" -r "${TMPDIR}/new.report" "${TMPDIR}/new" < test.asm > /dev/null
+"${ZASMDIFF}" "${TMPDIR}/old.report" "${TMPDIR}/new.report" \
+    > "${TMPDIR}/diff.txt"
+expectline "${TMPDIR}/diff.txt" "inc${TAB}foo.asm${TAB}7${TAB}4${TAB}-3"
+expectline "${TMPDIR}/diff.txt" "label${TAB}foo${TAB}3${TAB}4${TAB}+1"
+expectline "${TMPDIR}/diff.txt" "label${TAB}bar${TAB}4${TAB}-${TAB}-4"
+expectline "${TMPDIR}/diff.txt" "ram${TAB}FOO${TAB}16${TAB}32${TAB}+16"
+expectline "${TMPDIR}/diff.txt" "total${TAB}label${TAB}8${TAB}5${TAB}-3"
+if grep -q "start" "${TMPDIR}/diff.txt"; then
+    echo "unchanged label in diff"
+    cat "${TMPDIR}/diff.txt"
+    exit 1
+fi
+
+echo "zasmdiff, same builds"
+"${ZASMDIFF}" "${TMPDIR}/old.report" "${TMPDIR}/old.report" \
+    > "${TMPDIR}/same.txt"
+if grep -v "^total" "${TMPDIR}/same.txt"; then
+    echo "diff between identical reports"
+    exit 1
+fi
+
+echo "All tests passed!"
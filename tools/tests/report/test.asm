@@ -0,0 +1,6 @@
+; Fixture for runtests.sh. Its report is checked there.
+.equ	FOO_RAMSTART	0x8000
+	jp	start
+.inc "foo.asm"
+start:
+	halt
@@ -0,0 +1,83 @@
+#!/usr/bin/env bash
+
+set -e
+
+# Runs the emulated shell over a host directory ("shell -d") and checks that
+# what the guest does to its filesystem ends up in host files.
+
+SHELL_BIN=../../emul/shell/shell
+
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "${TMPDIR}"' EXIT
+
+# "first" is added alone, before "dir", so that it comes first in the image:
+# fsAlloc never re-uses the first file. New files go in "dir", the first
+# directory added.
+mkdir "${TMPDIR}/dir"
+printf 'hello\n' > "${TMPDIR}/first"
+printf '12345678' > "${TMPDIR}/dir/b"
+
+# XYZ is poked at 0x9000, then saved:
+# - over the beginning of "first" and after its end, which grows it;
+# - in "c", which re-uses the blocks of deleted "b";
+# - in "d", which fsAlloc appends to the image.
+# bcfl writes the block cache back before we exit.
+echo "Running shell -d"
+printf 'mptr 9000\npoke 3\nXYZ
+fopn 0 first\nbsel 1\nseek 00 0000\nsave 3\nseek 00 0006\nsave 3
+fdel b\nfnew 1 c\nfopn 1 c\nbsel 2\nsave 3
+fnew 1 d\nfopn 0 d\nbsel 1\nsave 3
+bcfl\n' | "${SHELL_BIN}" -d "${TMPDIR}/first" -d "${TMPDIR}/dir" > \
+    "${TMPDIR}/out" 2>&1
+if grep -q "ERR" "${TMPDIR}/out"; then
+    cat "${TMPDIR}/out"
+    exit 1
+fi
+
+chkfile() {
+    echo "Checking $1"
+    if [ ! -f "${TMPDIR}/$1" ]; then
+        echo "missing"
+        exit 1
+    fi
+    ACTUAL=$(cat "${TMPDIR}/$1")
+    if [ "${ACTUAL}" != "$2" ]; then
+        echo "got ${ACTUAL}, expected $2"
+        exit 1
+    fi
+}
+
+chkfile first "XYZlo
+XYZ"
+# "b" is renamed, and truncated: fsAlloc made it empty.
+chkfile dir/c XYZ
+chkfile dir/d XYZ
+if [ -e "${TMPDIR}/dir/b" ]; then
+    echo "b wasn't renamed"
+    exit 1
+fi
+if [ $(ls "${TMPDIR}/dir" | wc -l) -ne 2 ]; then
+    echo "unexpected files in dir"
+    exit 1
+fi
+
+# An app waiting for a line in stdioReadLine lets flushTask run: the block it
+# writes goes to fsdev while we wait, not when we exit. "app" puts 'Q' in the
+# selected blockdev (BLOCKDEV_SEL is at 0x4000) and reads a line.
+echo "Running an app waiting for input"
+mkdir "${TMPDIR}/bin"
+printf 'hello\n' > "${TMPDIR}/first"
+# ld ix, 0x4000 / ld a, 'Q' / call _blkPutC / call stdioReadLine / xor a / ret
+printf '\xdd\x21\x00\x40\x3e\x51\xcd\x4a\x00\xcd\x59\x00\xaf\xc9' \
+    > "${TMPDIR}/bin/app"
+(printf 'fopn 0 first\nbsel 1\napp\n'; sleep 1; printf '\n') | \
+    "${SHELL_BIN}" -d "${TMPDIR}/first" -d "${TMPDIR}/bin" > \
+    "${TMPDIR}/out" 2>&1
+chkfile first "Qello"
+if ! grep -q " 256 of 256 fsdev writes done meanwhile" "${TMPDIR}/out"; then
+    echo "block not written while the app waited"
+    cat "${TMPDIR}/out"
+    exit 1
+fi
+
+echo "All tests passed!"
@@ -0,0 +1,30 @@
+#!/usr/bin/env bash
+
+set -e
+
+# Prints lines through sms/vdp.asm in the sms emulator and checks that the
+# screen scrolled. Stats are printed so that this doubles as a benchmark for
+# console output.
+
+BASE=../../..
+TOOLS=../..
+ZASM="${TOOLS}/zasm.sh"
+SMS="${TOOLS}/emul/sms/sms"
+KERNEL="${BASE}/kernel"
+
+echo "Running sms test"
+BIN=$(mktemp)
+${ZASM} "${KERNEL}" < test.asm > "${BIN}"
+ACTUAL=$(${SMS} -s -b 10000000 "${BIN}" < /dev/null) || {
+    echo "failed with code $?"
+    rm "${BIN}"
+    exit 1
+}
+rm "${BIN}"
+if [[ "${ACTUAL}" != "$(cat test.expected)" ]]; then
+    echo "unexpected screen:"
+    echo "${ACTUAL}"
+    exit 1
+fi
+
+echo "All tests passed!"
@@ -0,0 +1,47 @@
+; Prints 60 lines through vdpPutC, then halts. Each line is "line X ..." where
+; X goes from '0' to 'k'. Used with the sms emulator to check the screen and to
+; benchmark console output.
+.equ	RAMSTART	0xc000
+.equ	TEST_LINE	RAMSTART
+.equ	VDP_RAMSTART	RAMSTART+1
+
+	jp	test
+
+.inc "core.asm"
+.inc "sms/vdp.asm"
+
+test:
+	ld	sp, 0xdff0
+	call	vdpInit
+	ld	a, '0'
+	ld	(TEST_LINE), a
+.loop:
+	ld	hl, sLine
+	call	printstr
+	ld	a, (TEST_LINE)
+	call	vdpPutC
+	ld	hl, sFox
+	call	printstr
+	ld	a, ASCII_CR
+	call	vdpPutC
+	ld	a, ASCII_LF
+	call	vdpPutC
+	ld	a, (TEST_LINE)
+	inc	a
+	ld	(TEST_LINE), a
+	cp	'0'+60
+	jr	nz, .loop
+	halt
+
+printstr:
+	ld	a, (hl)
+	or	a
+	ret	z
+	call	vdpPutC
+	inc	hl
+	jr	printstr
+
+sLine:
+	.db	"line ", 0
+sFox:
+	.db	" the quick brown fox", 0
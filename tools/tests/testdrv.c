@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <glob.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+/* testdrv runs unit tests (test_*.asm files in unit/, assembled and ran through
+ * runbin) and zasm tests (.asm files in zasm/, compared with their .expected
+ * counterpart) in parallel.
+ *
+ * Includes are served to zasm the same way zasm.sh does it. Each zasm and
+ * runbin run is guarded with an instruction budget and a timeout so that a
+ * test looping forever fails instead of hanging.
+ *
+ * Usage: testdrv [-j jobs] [-b budget] [-t secs] [-o junit.xml]
+ *
+ * With -o, a JUnit XML report is written with, for each test, its time and
+ * the instruction and T-state counts of both its assembling and its run.
+ *
+ * Must be ran from tools/tests.
+ */
+
+#define TOOLS ".."
+#define ZASM TOOLS "/emul/zasm/zasm"
+#define RUNBIN TOOLS "/emul/runbin/runbin"
+#define INCLUDES "../../kernel ../../apps"
+// In sync with guard/guard.h. runbin's exit code is the value of A, which can
+// be GUARD_EXIT_CODE, so guard limits are told by their message instead.
+#define GUARD_MSG "guard: "
+#define MAX_TESTS 0x100
+#define MAX_MSG 0x100
+#define MAX_CMD 0x400
+
+typedef struct {
+    char path[0x80];
+    char suite[0x10];
+    int unit;           // 1 for unit test, 0 for zasm comparison
+    int done;
+    int failed;
+    char msg[MAX_MSG];
+    uint64_t asminstrs;
+    uint64_t asmtstates;
+    uint64_t runinstrs;
+    uint64_t runtstates;
+    double secs;
+} Test;
+
+static Test *tests;
+static int testcount = 0;
+static uint64_t budget = 500000000;
+static unsigned timeout = 60;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void addtests(const char *pattern, const char *suite, int unit)
+{
+    glob_t g;
+    if (glob(pattern, 0, NULL, &g) != 0) {
+        return;
+    }
+    for (size_t i=0; i<g.gl_pathc; i++) {
+        if (testcount == MAX_TESTS) {
+            fprintf(stderr, "Too many tests\n");
+            exit(1);
+        }
+        Test *t = &tests[testcount++];
+        strncpy(t->path, g.gl_pathv[i], sizeof(t->path)-1);
+        strncpy(t->suite, suite, sizeof(t->suite)-1);
+        t->unit = unit;
+    }
+    globfree(&g);
+}
+
+// Reads guard stats in errpath. Non-stats lines are put in msg. Returns 1 if a
+// guard limit was reached.
+static int readstats(const char *errpath, uint64_t *instrs, uint64_t *tstates,
+    char *msg)
+{
+    FILE *fp = fopen(errpath, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    int guarded = 0;
+    char line[MAX_MSG];
+    unsigned long long i, t;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "instrs %llu tstates %llu", &i, &t) == 2) {
+            *instrs = i;
+            *tstates = t;
+            continue;
+        }
+        if (strncmp(line, GUARD_MSG, strlen(GUARD_MSG)) == 0) {
+            guarded = 1;
+        }
+        if (msg[0] == '\0') {
+            line[strcspn(line, "\n")] = '\0';
+            strncpy(msg, line, MAX_MSG-1);
+        }
+    }
+    fclose(fp);
+    return guarded;
+}
+
+// Runs cmd through the shell and returns its exit code.
+static int run(const char *cmd)
+{
+    int res = system(cmd);
+    if (!WIFEXITED(res)) {
+        return -1;
+    }
+    return WEXITSTATUS(res);
+}
+
+static int samefiles(const char *path1, const char *path2)
+{
+    FILE *fp1 = fopen(path1, "r");
+    FILE *fp2 = fopen(path2, "r");
+    int res = (fp1 != NULL) && (fp2 != NULL);
+    while (res) {
+        int c1 = fgetc(fp1);
+        int c2 = fgetc(fp2);
+        if (c1 != c2) {
+            res = 0;
+        } else if (c1 == EOF) {
+            break;
+        }
+    }
+    if (fp1 != NULL) {
+        fclose(fp1);
+    }
+    if (fp2 != NULL) {
+        fclose(fp2);
+    }
+    return res;
+}
+
+static void runtest(Test *t)
+{
+    char binpath[] = "/tmp/testdrvbinXXXXXX";
+    char errpath[] = "/tmp/testdrverrXXXXXX";
+    char cmd[MAX_CMD];
+    char msg[MAX_MSG] = {0};
+    double start = now();
+    close(mkstemp(binpath));
+    close(mkstemp(errpath));
+    snprintf(cmd, MAX_CMD, "%s -s -b %llu -t %u -i %s < %s > %s 2> %s", ZASM,
+        (unsigned long long)budget, timeout, INCLUDES, t->path, binpath,
+        errpath);
+    int res = run(cmd);
+    readstats(errpath, &t->asminstrs, &t->asmtstates, msg);
+    if (res != 0) {
+        // Either a zasm error or a guard limit. Both are explained in msg.
+        t->failed = 1;
+        snprintf(t->msg, MAX_MSG, "zasm: %.200s", msg);
+    } else if (t->unit) {
+        msg[0] = '\0';
+        snprintf(cmd, MAX_CMD, "%s -s -b %llu -t %u < %s 2> %s", RUNBIN,
+            (unsigned long long)budget, timeout, binpath, errpath);
+        res = run(cmd);
+        if (readstats(errpath, &t->runinstrs, &t->runtstates, msg)) {
+            t->failed = 1;
+            snprintf(t->msg, MAX_MSG, "runbin: %.200s", msg);
+        } else if (res != 0) {
+            t->failed = 1;
+            snprintf(t->msg, MAX_MSG, "failed with code %d", res);
+        }
+    } else {
+        char expected[sizeof(t->path)+0x10];
+        snprintf(expected, sizeof(expected), "%s.expected", t->path);
+        if (!samefiles(binpath, expected)) {
+            t->failed = 1;
+            snprintf(t->msg, MAX_MSG, "output differs from %s", expected);
+        }
+    }
+    unlink(binpath);
+    unlink(errpath);
+    t->secs = now() - start;
+    t->done = 1;
+}
+
+static void xmlstr(FILE *fp, const char *s)
+{
+    for (; *s != '\0'; s++) {
+        switch (*s) {
+        case '&': fputs("&amp;", fp); break;
+        case '<': fputs("&lt;", fp); break;
+        case '>': fputs("&gt;", fp); break;
+        case '"': fputs("&quot;", fp); break;
+        default: fputc(*s, fp);
+        }
+    }
+}
+
+static void prop(FILE *fp, const char *name, uint64_t val)
+{
+    fprintf(fp, "      <property name=\"%s\" value=\"%llu\"/>\n", name,
+        (unsigned long long)val);
+}
+
+static int writejunit(const char *path, double secs)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return 1;
+    }
+    int failures = 0;
+    for (int i=0; i<testcount; i++) {
+        failures += tests[i].failed;
+    }
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(fp, "<testsuites tests=\"%d\" failures=\"%d\" time=\"%.3f\">\n",
+        testcount, failures, secs);
+    const char *suite = NULL;
+    for (int i=0; i<testcount; i++) {
+        Test *t = &tests[i];
+        if ((suite == NULL) || (strcmp(suite, t->suite) != 0)) {
+            if (suite != NULL) {
+                fprintf(fp, "  </testsuite>\n");
+            }
+            suite = t->suite;
+            int count = 0;
+            int failed = 0;
+            for (int j=i; j<testcount; j++) {
+                if (strcmp(tests[j].suite, suite) == 0) {
+                    count++;
+                    failed += tests[j].failed;
+                }
+            }
+            fprintf(fp, "  <testsuite name=\"%s\" tests=\"%d\" failures=\"%d\">\n",
+                suite, count, failed);
+        }
+        fprintf(fp, "    <testcase classname=\"%s\" name=\"", t->suite);
+        xmlstr(fp, t->path);
+        fprintf(fp, "\" time=\"%.3f\">\n", t->secs);
+        fprintf(fp, "     <properties>\n");
+        prop(fp, "asm_instrs", t->asminstrs);
+        prop(fp, "asm_tstates", t->asmtstates);
+        if (t->unit) {
+            prop(fp, "run_instrs", t->runinstrs);
+            prop(fp, "run_tstates", t->runtstates);
+        }
+        fprintf(fp, "     </properties>\n");
+        if (t->failed) {
+            fprintf(fp, "      <failure message=\"");
+            xmlstr(fp, t->msg);
+            fprintf(fp, "\"/>\n");
+        }
+        fprintf(fp, "    </testcase>\n");
+    }
+    if (suite != NULL) {
+        fprintf(fp, "  </testsuite>\n");
+    }
+    fprintf(fp, "</testsuites>\n");
+    fclose(fp);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    char *junitpath = NULL;
+    int c;
+    while ((c = getopt(argc, argv, "j:b:t:o:")) != -1) {
+        switch (c) {
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 'b':
+            budget = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            timeout = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            junitpath = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: testdrv [-j jobs] [-b budget] [-t secs] [-o junit.xml]\n");
+            return 1;
+        }
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    // Results are written by child processes.
+    tests = mmap(NULL, sizeof(Test)*MAX_TESTS, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (tests == MAP_FAILED) {
+        fprintf(stderr, "Can't allocate results\n");
+        return 1;
+    }
+    memset(tests, 0, sizeof(Test)*MAX_TESTS);
+    addtests("unit/test_*.asm", "unit", 1);
+    addtests("zasm/*.asm", "zasm", 0);
+
+    double start = now();
+    int next = 0;
+    int running = 0;
+    pid_t pids[MAX_TESTS];
+    while ((next < testcount) || (running > 0)) {
+        if ((next < testcount) && (running < jobs)) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                if (running > 0) {
+                    // Try again when a running test is done.
+                    jobs = running;
+                    continue;
+                }
+                perror("fork");
+                return 1;
+            }
+            if (pid == 0) {
+                runtest(&tests[next]);
+                _exit(0);
+            }
+            pids[next++] = pid;
+            running++;
+            continue;
+        }
+        pid_t pid = wait(NULL);
+        running--;
+        for (int i=0; i<next; i++) {
+            if (pids[i] == pid) {
+                Test *t = &tests[i];
+                if (!t->done) {
+                    t->failed = 1;
+                    strcpy(t->msg, "test driver crashed");
+                }
+                printf("%s %s (%.2fs)%s%s\n", t->failed ? "FAIL" : "ok",
+                    t->path, t->secs, t->failed ? ": " : "", t->msg);
+                fflush(stdout);
+            }
+        }
+    }
+    double secs = now() - start;
+
+    int failures = 0;
+    for (int i=0; i<testcount; i++) {
+        failures += tests[i].failed;
+    }
+    printf("%d tests, %d failures in %.2fs\n", testcount, failures, secs);
+    if ((junitpath != NULL) && (writejunit(junitpath, secs) != 0)) {
+        return 1;
+    }
+    return failures ? 1 : 0;
+}
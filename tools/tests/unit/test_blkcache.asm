@@ -0,0 +1,384 @@
+.equ	RAMSTART	0x4000
+.equ	BLOCKDEV_COUNT	1
+; A fake device in memory. Its content is (addr & 0xff) ^ (addr >> 8). It's
+; growable: writing right after its end makes it bigger, up to 0x400 bytes,
+; unless DEV_FIXED is non-zero.
+.equ	DEV		0x8000
+.equ	DEV_MAXSIZE	0x400
+.equ	DEV_SIZE	RAMSTART
+; Number of GetC and PutC calls on the fake device
+.equ	DEV_READS	DEV_SIZE+2
+.equ	DEV_WRITES	DEV_READS+2
+.equ	DEV_FIXED	DEV_WRITES+2
+
+jp	test
+
+.inc "core.asm"
+.equ	BLOCKDEV_RAMSTART	DEV_FIXED+1
+.inc "blockdev.asm"
+.dw	blkcacheGetC, blkcachePutC
+
+.equ	BLKCACHE_RAMSTART	BLOCKDEV_RAMEND
+.equ	BLKCACHE_COUNT		2
+.inc "blkcache.asm"
+
+testNum:	.db 1
+
+devRoutines:
+	.dw	devGetC, devPutC
+
+; Make HL point to DEV+HL and set Z if HL is within DEV_SIZE. DE (high bytes of
+; the address) is ignored.
+devPlace:
+	push	de
+	ld	de, (DEV_SIZE)
+	call	cpHLDE
+	pop	de
+	jp	nc, unsetZ	; HL >= DEV_SIZE
+	push	de
+	ld	de, DEV
+	add	hl, de
+	pop	de
+	cp	a		; ensure Z
+	ret
+
+devGetC:
+	push	hl
+	ld	hl, (DEV_READS)
+	inc	hl
+	ld	(DEV_READS), hl
+	pop	hl \ push hl
+	call	devPlace
+	jr	nz, .end
+	ld	a, (hl)
+.end:
+	pop	hl
+	ret
+
+devPutC:
+	push	de
+	push	hl
+	push	af
+	ld	hl, (DEV_WRITES)
+	inc	hl
+	ld	(DEV_WRITES), hl
+	pop	af \ pop hl \ push hl \ push af
+	; growing?
+	ld	de, (DEV_SIZE)
+	call	cpHLDE
+	jr	nz, .place
+	ld	a, (DEV_FIXED)
+	or	a
+	jr	nz, .error
+	ld	de, DEV_MAXSIZE
+	call	cpHLDE
+	jr	z, .error
+	inc	hl
+	ld	(DEV_SIZE), hl
+	dec	hl
+.place:
+	call	devPlace
+	jr	nz, .error
+	pop	af
+	ld	(hl), a
+	cp	a		; ensure Z
+	jr	.end
+.error:
+	pop	af
+	call	unsetZ
+.end:
+	pop	hl
+	pop	de
+	ret
+
+; Sets Z if DEV_READS == HL
+chkReads:
+	push	de
+	ld	de, (DEV_READS)
+	call	cpHLDE
+	pop	de
+	ret
+
+; Sets Z if DEV_WRITES == HL
+chkWrites:
+	push	de
+	ld	de, (DEV_WRITES)
+	call	cpHLDE
+	pop	de
+	ret
+
+; Reads address HL through the cache and sets Z if we get the device's
+; original content.
+chkGetC:
+	push	hl
+	call	blkGetCAt
+	jr	nz, .end
+	xor	l
+	xor	h
+.end:
+	pop	hl
+	ret
+
+blkGetCAt:
+	push	de
+	ld	de, 0
+	ld	a, BLOCKDEV_SEEK_ABSOLUTE
+	call	blkSeek
+	pop	de
+	jp	blkGetC
+
+; Writes A at address HL through the cache.
+blkPutCAt:
+	push	af
+	push	de
+	ld	de, 0
+	ld	a, BLOCKDEV_SEEK_ABSOLUTE
+	call	blkSeek
+	pop	de
+	pop	af
+	jp	blkPutC
+
+test:
+	ld	sp, 0xffff
+
+	; Our device is 3.5 blocks
+	ld	hl, DEV
+	ld	bc, DEV_MAXSIZE
+.fill:
+	ld	a, l
+	xor	h
+	xor	0x80		; DEV >> 8
+	ld	(hl), a
+	inc	hl
+	dec	bc
+	ld	a, b
+	or	c
+	jr	nz, .fill
+	ld	hl, 0x380
+	ld	(DEV_SIZE), hl
+	ld	hl, 0
+	ld	(DEV_READS), hl
+	ld	(DEV_WRITES), hl
+	xor	a
+	ld	(DEV_FIXED), a
+
+	; IX is preserved
+	ld	ix, 0x1234
+	call	blkcacheInit
+	push	ix \ pop hl
+	ld	de, 0x1234
+	call	cpHLDE
+	jp	nz, fail
+	ld	hl, devRoutines
+	ld	de, BLKCACHE_BLK
+	call	blkSet
+	xor	a
+	ld	de, BLOCKDEV_SEL
+	call	blkSel
+
+	; A miss loads the whole block
+	ld	hl, 0x123
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x100
+	call	chkReads
+	jp	nz, fail
+	call	nexttest
+
+	; Then, the whole block is a hit
+	ld	hl, 0x1ff
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x100
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x100
+	call	chkReads
+	jp	nz, fail
+	call	nexttest
+
+	; Writes stay in the cache until we flush. A is preserved.
+	ld	hl, 0x105
+	ld	a, 'x'
+	call	blkPutCAt
+	jp	nz, fail
+	cp	'x'
+	jp	nz, fail
+	call	blkGetCAt
+	jp	nz, fail
+	cp	'x'
+	jp	nz, fail
+	ld	a, (DEV+0x105)
+	cp	'x'
+	jp	z, fail
+	ld	hl, 0
+	call	chkWrites
+	jp	nz, fail
+	call	blkcacheFlush
+	jp	nz, fail
+	ld	a, (DEV+0x105)
+	cp	'x'
+	jp	nz, fail
+	ld	hl, 0x100
+	call	chkWrites
+	jp	nz, fail
+	; Nothing is dirty anymore
+	call	blkcacheFlush
+	jp	nz, fail
+	ld	hl, 0x100
+	call	chkWrites
+	jp	nz, fail
+	call	nexttest
+
+	; We have 2 entries. Block 1 is in one of them. Load block 0, use block
+	; 1, then load block 2: block 0 is evicted.
+	ld	hl, 0x000
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x1ff
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x200
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x300
+	call	chkReads
+	jp	nz, fail
+	ld	hl, 0x1fe
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x300
+	call	chkReads
+	jp	nz, fail
+	ld	hl, 0x001
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x400
+	call	chkReads
+	jp	nz, fail
+	call	nexttest
+
+	; Dirty blocks are written back when evicted.
+	ld	hl, 0x002
+	ld	a, 'y'
+	call	blkPutCAt
+	jp	nz, fail
+	ld	hl, 0x102	; block 1 is still there
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x100
+	call	chkWrites
+	jp	nz, fail
+	ld	hl, 0x202	; loads block 2, evicts block 0 (dirty)
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x200
+	call	chkWrites
+	jp	nz, fail
+	ld	a, (DEV+0x002)
+	cp	'y'
+	jp	nz, fail
+	call	nexttest
+
+	; The last block is partial. Reading past the end of the device fails,
+	; but writing right after it grows it.
+	ld	hl, 0x37f
+	call	chkGetC
+	jp	nz, fail
+	ld	hl, 0x380
+	call	chkGetC
+	jp	z, fail
+	ld	hl, 0x380
+	ld	a, 'z'
+	call	blkPutCAt
+	jp	nz, fail
+	call	blkGetCAt
+	jp	nz, fail
+	cp	'z'
+	jp	nz, fail
+	call	blkcacheFlush
+	jp	nz, fail
+	ld	hl, (DEV_SIZE)
+	ld	de, 0x381
+	call	cpHLDE
+	jp	nz, fail
+	ld	a, (DEV+0x380)
+	cp	'z'
+	jp	nz, fail
+	call	nexttest
+
+	; When the device can't grow, that write is refused right away and the
+	; block isn't extended.
+	ld	a, 1
+	ld	(DEV_FIXED), a
+	ld	hl, 0x381
+	ld	a, 'z'
+	call	blkPutCAt
+	jp	z, fail
+	call	chkGetC
+	jp	z, fail
+	xor	a
+	ld	(DEV_FIXED), a
+	call	nexttest
+
+	; Writing further than that goes directly to the device, which refuses
+	; it. Blocks beyond the end of the device can't be read.
+	ld	hl, 0x390
+	ld	a, 'z'
+	call	blkPutCAt
+	jp	z, fail
+	ld	hl, 0x500
+	call	chkGetC
+	jp	z, fail
+	call	nexttest
+
+	; Stats: out of 21 accesses, 7 were misses: 0x123, 0x000, 0x200, 0x001,
+	; 0x202, 0x37f and 0x500.
+	ld	hl, (BLKCACHE_MISSES)
+	ld	de, 7
+	call	cpHLDE
+	jp	nz, fail
+	ld	hl, (BLKCACHE_HITS)
+	ld	de, 14
+	call	cpHLDE
+	jp	nz, fail
+	call	nexttest
+
+	; Dropping writes dirty blocks back and forgets everything: the device
+	; can then change behind our back, we see it.
+	ld	hl, 0x201
+	ld	a, 'w'
+	call	blkPutCAt
+	jp	nz, fail
+	call	blkcacheDrop
+	jp	nz, fail
+	ld	a, (DEV+0x201)
+	cp	'w'
+	jp	nz, fail
+	ld	a, 'v'
+	ld	(DEV+0x202), a
+	ld	hl, 0x202
+	call	blkGetCAt
+	jp	nz, fail
+	cp	'v'
+	jp	nz, fail
+	; Both 0x201 (block 2 was evicted by 0x500) and 0x202 were misses.
+	ld	hl, (BLKCACHE_MISSES)
+	ld	de, 9
+	call	cpHLDE
+	jp	nz, fail
+	call	nexttest
+
+	; success
+	xor	a
+	halt
+
+nexttest:
+	ld	a, (testNum)
+	inc	a
+	ld	(testNum), a
+	ret
+
+fail:
+	ld	a, (testNum)
+	halt
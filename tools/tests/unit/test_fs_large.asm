@@ -0,0 +1,324 @@
+.equ	RAMSTART	0x4000
+.equ	BLOCKDEV_COUNT	1
+; Metadata of our large file, which we can write to.
+.equ	DEV_META	RAMSTART
+; Last data write on our device: E, L, H, then the byte.
+.equ	DEV_LASTW	DEV_META+0x20
+
+jp	test
+
+.inc "core.asm"
+.equ	BLOCKDEV_RAMSTART	DEV_LASTW+4
+.inc "blockdev.asm"
+.dw	devGetC, devPutC
+
+.equ	FS_RAMSTART	BLOCKDEV_RAMEND
+.equ	FS_HANDLE_COUNT	1
+.inc "fs.asm"
+
+testNum:	.db 1
+
+; Our device is 0x2a320 bytes long. A 3 bytes file at 0, a 0x2a0e5 bytes large
+; file at 0x100 (0x2a2 blocks) and the chain's end block at 0x2a300. Data bytes
+; are (addr & 0xff) ^ ((addr >> 8) & 0xff) ^ (addr >> 16).
+smallMeta:
+	.db	"CFS", 0x01, 0x03, 0x00, "small"
+	.fill	0x20-11
+largeMeta:
+	.db	"CFS", 0xa2, 0xe5, 0xa0, "large"
+	.fill	0x1d-11
+	.db	0x02, 0x02, FS_FLAG_LARGE
+endMeta:
+	.db	"CFS"
+	.fill	0x20-3
+
+; E, H and pointer of each metadata block of the device
+devMetas:
+	.db	0x00, 0x00
+	.dw	smallMeta
+	.db	0x00, 0x01
+	.dw	DEV_META
+	.db	0x02, 0xa3
+	.dw	endMeta
+
+sSmall:
+	.db	"small", 0
+sLarge:
+	.db	"large", 0
+
+; Sets C if E:HL is lower than A:BC
+devLower:
+	cp	e
+	jr	z, .low
+	ccf
+	ret
+.low:
+	push	hl
+	or	a		; reset carry
+	sbc	hl, bc
+	pop	hl
+	ret
+
+; Sets Z if DE/HL is within the device
+devWithin:
+	ld	a, d
+	or	a
+	jp	nz, unsetZ
+	push	bc
+	ld	a, 0x02
+	ld	bc, 0xa320
+	call	devLower
+	pop	bc
+	jp	nc, unsetZ
+	cp	a		; ensure Z
+	ret
+
+; Sets Z if DE/HL is in a metadata block and, if it is, make HL point to the
+; byte holding it.
+devMeta:
+	ld	a, l
+	cp	FS_METASIZE
+	jp	nc, unsetZ
+	push	bc
+	push	ix
+	ld	ix, devMetas
+	ld	b, 3
+.loop:
+	ld	a, (ix)
+	cp	e
+	jr	nz, .next
+	ld	a, (ix+1)
+	cp	h
+	jr	z, .found
+.next:
+	inc	ix \ inc ix \ inc ix \ inc ix
+	djnz	.loop
+	call	unsetZ
+	jr	.end
+.found:
+	ld	a, l
+	ld	l, (ix+2)
+	ld	h, (ix+3)
+	call	addHL
+	cp	a		; ensure Z
+.end:
+	pop	ix
+	pop	bc
+	ret
+
+devGetC:
+	call	devWithin
+	ret	nz
+	push	hl
+	call	devMeta
+	jr	nz, .data
+	ld	a, (hl)
+	jr	.end
+.data:
+	ld	a, l
+	xor	h
+	xor	e
+.end:
+	pop	hl
+	cp	a		; ensure Z
+	ret
+
+devPutC:
+	push	bc
+	push	hl
+	ld	b, a
+	call	devWithin
+	jr	nz, .end
+	call	devMeta
+	jr	nz, .data
+	ld	(hl), b
+	jr	.end
+.data:
+	ld	a, e
+	ld	(DEV_LASTW), a
+	ld	(DEV_LASTW+1), hl
+	ld	a, b
+	ld	(DEV_LASTW+3), a
+	cp	a		; ensure Z
+.end:
+	ld	a, b
+	pop	hl
+	pop	bc
+	ret
+
+; Sets Z if the size of handle (IX) is C:HL
+chkSize:
+	ld	a, (ix+6)
+	cp	c
+	ret	nz
+	ld	a, (ix+4)
+	cp	l
+	ret	nz
+	ld	a, (ix+5)
+	cp	h
+	ret
+
+; Sets Z if large file's metadata has C:HL as its size
+chkMetaSize:
+	ld	a, (DEV_META+FS_META_FSIZEH_OFFSET)
+	cp	c
+	ret	nz
+	push	de
+	ld	de, (DEV_META+FS_META_FSIZE_OFFSET)
+	call	cpHLDE
+	pop	de
+	ret
+
+test:
+	ld	sp, 0xffff
+
+	ld	hl, largeMeta
+	ld	de, DEV_META
+	ld	bc, 0x20
+	ldir
+
+	call	fsInit
+	xor	a
+	ld	de, BLOCKDEV_SEL
+	call	blkSel
+	call	fsOn
+	jp	nz, fail
+	ld	hl, sLarge
+	call	fsFindFN
+	jp	nz, fail
+	ld	ix, FS_HANDLES
+	call	fsOpen
+	ld	c, 0x02
+	ld	hl, 0xa0e5
+	call	chkSize
+	jp	nz, fail
+	ld	a, (ix+7)
+	cp	FS_FLAG_LARGE
+	jp	nz, fail
+	call	nexttest
+
+	; Reads, 24-bit positions
+	ld	de, 0
+	ld	hl, 0
+	call	fsGetC
+	jp	nz, fail
+	cp	0x21		; 0x120
+	jp	nz, fail
+	ld	de, 0x0002
+	ld	hl, 0x1234
+	call	fsGetC
+	jp	nz, fail
+	cp	0x45		; 0x21354
+	jp	nz, fail
+	ld	hl, 0xa0e4	; last byte
+	call	fsGetC
+	jp	nz, fail
+	cp	0xa4		; 0x2a204
+	jp	nz, fail
+	call	nexttest
+
+	; Out of bounds
+	ld	hl, 0xa0e5
+	call	fsGetC
+	jp	z, fail
+	ld	de, 0x0003
+	ld	hl, 0
+	call	fsGetC
+	jp	z, fail
+	ld	de, 0x0102
+	call	fsGetC
+	jp	z, fail
+	call	nexttest
+
+	; Appending grows the file, in the handle and in metadata.
+	ld	de, 0x0002
+	ld	hl, 0xa0e5
+	ld	a, 'x'
+	call	fsPutC
+	jp	nz, fail
+	ld	a, (DEV_LASTW)
+	cp	0x02
+	jp	nz, fail
+	push	de
+	ld	de, (DEV_LASTW+1)
+	ld	hl, 0xa205
+	call	cpHLDE
+	pop	de
+	jp	nz, fail
+	ld	a, (DEV_LASTW+3)
+	cp	'x'
+	jp	nz, fail
+	ld	c, 0x02
+	ld	hl, 0xa0e6
+	call	chkSize
+	jp	nz, fail
+	call	chkMetaSize
+	jp	nz, fail
+	call	nexttest
+
+	; Set size across a 64K boundary
+	ld	de, 0x0001
+	ld	hl, 0
+	call	fsSetSize
+	jp	nz, fail
+	ld	c, 0x01
+	ld	hl, 0
+	call	chkSize
+	jp	nz, fail
+	call	chkMetaSize
+	jp	nz, fail
+	call	nexttest
+
+	; Walk the chain: small file, large file, then the end block.
+	call	fsBegin
+	jp	nz, fail
+	call	fsNext
+	jp	nz, fail
+	call	fsNext
+	jp	nz, fail
+	call	fsblkTell
+	push	hl
+	ld	hl, 0x0002
+	call	cpHLDE
+	pop	hl
+	jp	nz, fail
+	ld	de, 0xa300
+	call	cpHLDE
+	jp	nz, fail
+	call	fsNext
+	jp	z, fail
+	call	nexttest
+
+	; Regular files are unchanged
+	ld	hl, sSmall
+	call	fsFindFN
+	jp	nz, fail
+	call	fsOpen
+	ld	c, 0
+	ld	hl, 3
+	call	chkSize
+	jp	nz, fail
+	ld	de, 0
+	ld	hl, 2
+	call	fsGetC
+	jp	nz, fail
+	cp	0x22
+	jp	nz, fail
+	inc	hl
+	call	fsGetC
+	jp	z, fail
+	call	nexttest
+
+	; success
+	xor	a
+	halt
+
+nexttest:
+	ld	a, (testNum)
+	inc	a
+	ld	(testNum), a
+	ret
+
+fail:
+	ld	a, (testNum)
+	halt
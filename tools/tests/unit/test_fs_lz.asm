@@ -0,0 +1,126 @@
+.equ	RAMSTART	0x4000
+.equ	BLOCKDEV_COUNT	1
+
+jp	test
+
+.inc "core.asm"
+.equ	BLOCKDEV_RAMSTART	RAMSTART
+.inc "blockdev.asm"
+.dw	blobGetC, blobPutC
+
+.equ	FS_RAMSTART	BLOCKDEV_RAMEND
+.equ	FS_HANDLE_COUNT	1
+.inc "fs.asm"
+
+testNum:	.db 1
+
+; A CFS with a single compressed 300 bytes file, made with "cfspack -c".
+; File content is ((i*7) mod 13)+'a' for each byte i.
+blob:
+	.db	0x43, 0x46, 0x53, 0x01, 0x2c, 0x01, 0x6c, 0x7a
+	.db	0x2e, 0x74, 0x78, 0x74, 0x00, 0x00, 0x00, 0x00
+	.db	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	.db	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01
+	.db	0x04, 0x00, 0x16, 0x00, 0x0c, 0x61, 0x68, 0x62
+	.db	0x69, 0x63, 0x6a, 0x64, 0x6b, 0x65, 0x6c, 0x66
+	.db	0x6d, 0x67, 0xff, 0x0c, 0xee, 0x0c, 0x0c, 0x6c
+	.db	0x66, 0x6d, 0x67, 0x61, 0x68, 0x62, 0x69, 0x63
+	.db	0x6a, 0x64, 0x6b, 0x65, 0x9c, 0x0c
+
+; DE/HL is an offset in blob
+blobGetC:
+	push	hl
+	push	de
+	ld	de, blob
+	add	hl, de
+	ld	a, (hl)
+	pop	de
+	pop	hl
+	cp	a		; ensure Z
+	ret
+
+blobPutC:
+	jp	unsetZ
+
+test:
+	ld	sp, 0xffff
+
+	call	fsInit
+	xor	a
+	ld	de, BLOCKDEV_SEL
+	call	blkSel
+	call	fsOn
+	jp	nz, fail
+	call	fsBegin
+	jp	nz, fail
+	ld	ix, FS_HANDLES
+	call	fsOpen
+	call	nexttest
+
+	; Read the whole file sequentially. B is the expected (i*7) mod 13.
+	ld	de, 0
+	ld	hl, 0
+	ld	b, 0
+.loop:
+	call	fsGetC
+	jp	nz, fail
+	sub	'a'
+	cp	b
+	jp	nz, fail
+	ld	a, b
+	add	a, 7
+	cp	13
+	jr	c, .noMod
+	sub	13
+.noMod:
+	ld	b, a
+	inc	hl
+	ld	a, h
+	cp	0x01
+	jr	nz, .loop
+	ld	a, l
+	cp	0x2c		; 300 == 0x12c
+	jr	nz, .loop
+	call	nexttest
+
+	; EOF
+	call	fsGetC
+	jp	z, fail
+	call	nexttest
+
+	; Seek back in the first chunk: (3*7) mod 13 == 8
+	ld	hl, 3
+	call	fsGetC
+	jp	nz, fail
+	cp	'a'+8
+	jp	nz, fail
+	call	nexttest
+
+	; and then in the second one: (299*7) mod 13 == 0
+	ld	hl, 299
+	call	fsGetC
+	jp	nz, fail
+	cp	'a'
+	jp	nz, fail
+	call	nexttest
+
+	; Compressed files are read-only
+	ld	hl, 0
+	ld	a, 'z'
+	call	fsPutC
+	jp	z, fail
+	call	nexttest
+
+	; success
+	xor	a
+	halt
+
+nexttest:
+	ld	a, (testNum)
+	inc	a
+	ld	(testNum), a
+	ret
+
+fail:
+	ld	a, (testNum)
+	halt
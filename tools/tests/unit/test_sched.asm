@@ -0,0 +1,227 @@
+.equ	RAMSTART	0x4000
+; What tasks did, in order: one char per step.
+.equ	LOG		RAMSTART
+.equ	LOG_PTR		LOG+0x10
+; Tasks waiting on it stop when it's non-zero
+.equ	FLAG		LOG_PTR+2
+
+jp	test
+
+.inc "core.asm"
+.equ	SCHED_RAMSTART	FLAG+1
+.equ	SCHED_COUNT	3
+.equ	SCHED_STACKSIZE	0x40
+.inc "sched.asm"
+
+testNum:	.db 1
+
+; Append A to the log
+log:
+	push	hl
+	ld	hl, (LOG_PTR)
+	ld	(hl), a
+	inc	hl
+	ld	(hl), 0
+	ld	(LOG_PTR), hl
+	pop	hl
+	ret
+
+clearLog:
+	push	hl
+	ld	hl, LOG
+	ld	(LOG_PTR), hl
+	ld	(hl), 0
+	pop	hl
+	ret
+
+; Sets Z if the log is the same as null-terminated string at HL.
+chkLog:
+	push	de
+	ld	de, LOG
+.loop:
+	ld	a, (de)
+	cp	(hl)
+	jr	nz, .end
+	or	a
+	jr	z, .end
+	inc	de
+	inc	hl
+	jr	.loop
+.end:
+	pop	de
+	ret
+
+taskA:
+	ld	b, 2
+.loop:
+	ld	a, 'a'
+	call	log
+	call	schedYield
+	djnz	.loop
+	ret
+
+taskB:
+	ld	a, 'b'
+	call	log
+	call	schedYield
+	ld	a, 'b'
+	jp	log		; and end
+
+taskSleep:
+	ld	hl, 2
+	call	schedSleep
+	ld	a, 'c'
+	jp	log
+
+taskWait:
+	call	schedYield
+	ld	a, (FLAG)
+	or	a
+	jr	z, taskWait
+	ret
+
+test:
+	ld	sp, 0xffff
+	call	schedInit
+	call	clearLog
+
+	; Tasks run round-robin, main included, and end when they return.
+	ld	hl, taskA
+	call	schedSpawn
+	jp	nz, fail
+	cp	1
+	jp	nz, fail
+	ld	hl, taskB
+	call	schedSpawn
+	jp	nz, fail
+	cp	2
+	jp	nz, fail
+	call	schedYield
+	ld	hl, .sAB
+	call	chkLog
+	jp	nz, fail
+	call	schedYield	; taskB ends
+	ld	hl, .sABAB
+	call	chkLog
+	jp	nz, fail
+	call	schedYield	; taskA ends
+	ld	hl, .sABAB
+	call	chkLog
+	jp	nz, fail
+	call	nexttest
+
+	; Yielding preserves registers
+	ld	hl, taskA
+	call	schedSpawn
+	jp	nz, fail
+	ld	bc, 0x1234
+	ld	de, 0x5678
+	ld	hl, 0x9abc
+	ld	ix, 0xdef0
+	ld	iy, 0x4321
+	ld	a, 0x42
+	call	schedYield
+	cp	0x42
+	jp	nz, fail
+	push	hl
+	ld	hl, 0x1234
+	sbc	hl, bc
+	pop	hl
+	jp	nz, fail
+	push	hl
+	ld	hl, 0x5678
+	sbc	hl, de
+	pop	hl
+	jp	nz, fail
+	push	de
+	ld	de, 0x9abc
+	call	cpHLDE
+	pop	de
+	jp	nz, fail
+	push	ix \ pop hl
+	ld	de, 0xdef0
+	call	cpHLDE
+	jp	nz, fail
+	push	iy \ pop hl
+	ld	de, 0x4321
+	call	cpHLDE
+	jp	nz, fail
+	call	schedYield
+	call	schedYield	; taskA ends
+	call	nexttest
+
+	; Slots of ended tasks are re-used. When they're all used, spawning
+	; fails.
+	xor	a
+	ld	(FLAG), a
+	ld	hl, taskWait
+	call	schedSpawn
+	jp	nz, fail
+	cp	1
+	jp	nz, fail
+	call	schedSpawn
+	jp	nz, fail
+	cp	2
+	jp	nz, fail
+	call	schedSpawn
+	jp	z, fail
+	ld	a, 1
+	ld	(FLAG), a
+	call	schedYield	; both were yielding before looking at FLAG
+	call	schedYield	; both end
+	call	schedSpawn
+	jp	nz, fail
+	cp	1
+	jp	nz, fail
+	call	schedYield
+	call	schedYield	; ends
+	call	nexttest
+
+	; Sleeping tasks don't run until enough ticks have happened.
+	call	clearLog
+	ld	hl, taskSleep
+	call	schedSpawn
+	jp	nz, fail
+	call	schedYield	; taskSleep sleeps
+	call	schedYield
+	ld	hl, .sEmpty
+	call	chkLog
+	jp	nz, fail
+	call	schedInt
+	call	schedYield
+	ld	hl, .sEmpty
+	call	chkLog
+	jp	nz, fail
+	call	schedInt
+	call	schedYield
+	ld	hl, .sC
+	call	chkLog
+	jp	nz, fail
+	ld	hl, (SCHED_TICKS)
+	ld	de, 2
+	call	cpHLDE
+	jp	nz, fail
+	call	nexttest
+
+	; success
+	xor	a
+	halt
+
+.sAB:
+	.db	"ab", 0
+.sABAB:
+	.db	"abab", 0
+.sC:
+	.db	"c"
+.sEmpty:
+	.db	0
+
+nexttest:
+	ld	a, (testNum)
+	inc	a
+	ld	(testNum), a
+	ret
+
+fail:
+	ld	a, (testNum)
+	halt
@@ -0,0 +1,115 @@
+#!/usr/bin/env bash
+
+set -e
+
+# Assembles the emulated shell kernel unit by unit, links it and compares the
+# result with the monolithic assembly of the same units.
+
+TOOLS=../..
+KERNEL=../../../kernel
+ZASM="${TOOLS}/zasm.sh"
+ZOBJ="${TOOLS}/zld/zobj"
+ZLD="${TOOLS}/zld/zld"
+SHELLDIR="${TOOLS}/emul/shell"
+UNITS="${SHELLDIR}/shell_.asm"
+for u in core parse blockdev blkcache mmap stdio fs shell blockdev_cmds fs_cmds \
+    blkcache_cmds pgm sched init; do
+    UNITS="${UNITS} ${SHELLDIR}/units/${u}.asm"
+done
+
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "${TMPDIR}"' EXIT
+
+OBJS=""
+PREVS=""
+for u in ${UNITS}; do
+    OBJ="${TMPDIR}/$(basename ${u} .asm).zo"
+    echo "Assembling ${u}"
+    "${ZOBJ}" ${PREVS} -o "${OBJ}" "${u}" "${KERNEL}"
+    OBJS="${OBJS} ${OBJ}"
+    PREVS="${PREVS} -p ${OBJ}"
+done
+
+cmplink() {
+    BASE=$1
+    echo "Linking at ${BASE}"
+    EXPECTED=$( (echo ".org ${BASE}"; cat ${UNITS}) | ${ZASM} "${KERNEL}" | xxd)
+    ACTUAL=$("${ZLD}" -b ${BASE} ${OBJS} | xxd)
+    if [ "$ACTUAL" != "$EXPECTED" ]; then
+        echo "linked binary differs from monolithic binary"
+        exit 1
+    fi
+}
+
+cmplink 0
+cmplink 0x1234
+
+# Userspace calls the kernel through the jump table at the addresses user.h
+# hard-codes, and the timer interrupt (IM 1) goes to 0x38. Check that each of
+# those addresses holds a jump to the right routine.
+echo "Checking the jump table"
+"${ZLD}" -m "${TMPDIR}/shell.map" ${OBJS} > "${TMPDIR}/shell.bin"
+chkjp() {
+    TARGET=$(awk -v l="$2" 'NF == 2 && $2 == l { print $1 }' "${TMPDIR}/shell.map")
+    EXPECTED="c3${TARGET:2:2}${TARGET:0:2}"
+    ACTUAL=$(xxd -s $1 -l 3 -p "${TMPDIR}/shell.bin")
+    if [ -z "${TARGET}" ] || [ "${ACTUAL}" != "${EXPECTED}" ]; then
+        echo "$(printf 0x%02x $1) doesn't jump to $2"
+        exit 1
+    fi
+}
+chkjp 0x38 schedInt
+ADDR=0
+while read -r EQU NAME VAL REST; do
+    [ "${EQU}" = ".equ" ] || continue
+    case "${VAL}" in
+        0x*) ADDR=$((VAL)) ;;
+        @+3) ADDR=$((ADDR+3)) ;;
+        *) continue ;;
+    esac
+    if [ ${ADDR} -lt 256 ]; then
+        chkjp ${ADDR} ${NAME}
+    fi
+done < "${SHELLDIR}/user.h"
+
+chkerr() {
+    echo "Checking that $1 fails"
+    if "$@" > /dev/null 2>&1; then
+        echo "should have failed"
+        exit 1
+    fi
+}
+
+# units can't have .org
+echo ".org 0x100" > "${TMPDIR}/org.asm"
+chkerr "${ZOBJ}" -o "${TMPDIR}/org.zo" "${TMPDIR}/org.asm"
+
+# used undefined symbols are link errors
+echo "jp foo" > "${TMPDIR}/undef.asm"
+"${ZOBJ}" -o "${TMPDIR}/undef.zo" "${TMPDIR}/undef.asm"
+chkerr "${ZLD}" "${TMPDIR}/undef.zo"
+
+# labels defined twice are link errors
+echo "foo: ret" > "${TMPDIR}/dup.asm"
+"${ZOBJ}" -o "${TMPDIR}/dup.zo" "${TMPDIR}/dup.asm"
+chkerr "${ZLD}" "${TMPDIR}/dup.zo" "${TMPDIR}/dup.zo"
+
+# imported labels can't be used as bytes
+echo "ld a, foo" > "${TMPDIR}/byte.asm"
+chkerr "${ZOBJ}" -o "${TMPDIR}/byte.zo" "${TMPDIR}/byte.asm"
+
+# objects are reassembled when a file pulled by .bin (or .inc) changes
+echo "Checking that .bin files are part of the hash"
+echo ".bin \"data.h\"" > "${TMPDIR}/bin.asm"
+echo "foo" > "${TMPDIR}/data.h"
+"${ZOBJ}" -o "${TMPDIR}/bin.zo" "${TMPDIR}/bin.asm" "${TMPDIR}"
+HASH1=$(grep "^hash" "${TMPDIR}/bin.zo")
+echo "bar" > "${TMPDIR}/data.h"
+"${ZOBJ}" -o "${TMPDIR}/bin.zo" "${TMPDIR}/bin.asm" "${TMPDIR}"
+HASH2=$(grep "^hash" "${TMPDIR}/bin.zo")
+if [ "${HASH1}" = "${HASH2}" ]; then
+    echo "stale object"
+    exit 1
+fi
+
+echo "All tests passed!"
@@ -4,18 +4,12 @@
 # so, if we can't get readlink -f to work, try python with a realpath implementation
 ABS_PATH=$(readlink -f "$0" || python -c "import sys, os; print(os.path.realpath('$0'))")
 
-# wrapper around ./emul/zasm/zasm that prepares includes CFS prior to call
+# wrapper around ./emul/zasm/zasm that serves the .h and .asm files of its
+# arguments as includes. They're read from the host as zasm needs them instead
+# of being packed in a CFS first (see emul/cfsdir/cfsdir.h). Like with
+# cfspack -c, they're compressed: zasm reads them through fs.asm, which
+# decompresses them on the fly. Options, such as "-r report", go through.
 DIR=$(dirname "${ABS_PATH}")
 ZASMBIN="${DIR}/emul/zasm/zasm"
-CFSPACK="${DIR}/cfspack/cfspack"
-INCCFS=$(mktemp)
 
-for p in "$@"; do
-    "${CFSPACK}" "${p}" "*.h" >> "${INCCFS}"    
-    "${CFSPACK}" "${p}" "*.asm" >> "${INCCFS}"    
-done
-
-"${ZASMBIN}" "${INCCFS}"
-RES=$?
-rm "${INCCFS}"
-exit $RES
+exec "${ZASMBIN}" -i "$@"
@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+
+# Compares two reports written by "zasm -r" (see emul/zasm/report.h) and prints
+# what changed, one line per include, label or RAM range whose byte count
+# changed, appeared or disappeared:
+#
+# <type> <name> <old bytes> <new bytes> <delta>
+#
+# followed by a "total" line for each type. Bytes of entries that aren't in one
+# of the reports are "-" and count as 0. Fields are tab separated.
+
+if [ $# -ne 2 ]; then
+    echo "Usage: zasmdiff.sh old.report new.report" >&2
+    exit 1
+fi
+
+awk -F '\t' '
+    FNR == 1 { file++ }
+    # Byte count is the last field. An include can be there more than once,
+    # we sum them.
+    $1 != "end" {
+        key = $1 "\t" $2
+        if (file == 1) {
+            old[key] += $NF
+        } else {
+            new[key] += $NF
+        }
+        if (!(key in seen)) {
+            seen[key] = 1
+            keys[n++] = key
+        }
+    }
+    END {
+        for (i=0; i<n; i++) {
+            key = keys[i]
+            split(key, parts, "\t")
+            o = (key in old) ? old[key] : "-"
+            w = (key in new) ? new[key] : "-"
+            delta = w - o
+            if (o != w) {
+                printf "%s\t%s\t%s\t%+d\n", key, o, w, delta
+            }
+            otot[parts[1]] += o
+            ntot[parts[1]] += w
+        }
+        split("inc label ram", types, " ")
+        for (i=1; i<=3; i++) {
+            t = types[i]
+            printf "total\t%s\t%d\t%d\t%+d\n", t, otot[t], ntot[t], ntot[t] - otot[t]
+        }
+    }
+' "$1" "$2"
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/* zld links objects made by zobj into a flat binary.
+ *
+ * Units are placed one after the other, in the order they're specified,
+ * starting at the base address. Fixups are then patched: "rel" fixups get the
+ * unit's address added and "imp" fixups get the value of the imported symbol
+ * added.
+ *
+ * Like zasm, when an absolute symbol is defined more than once, the first
+ * definition wins. A label defined twice is an error.
+ *
+ * Usage: zld [-b base] [-m mapfile] unit.zo... > out.bin
+ */
+
+#define MAX_UNITS 0x40
+#define MAX_NAME 0x40
+#define MAX_SYMS 0x800
+#define MAX_FIXUPS 0x1000
+#define MAX_IMPORTS 0x100
+
+#define EXP_ABS 0
+#define EXP_REL 1
+#define EXP_IMP 2
+
+typedef struct {
+    char name[MAX_NAME];
+    int unit;
+    int kind;
+    int val;        // value for ABS, offset for REL, addend for IMP
+    int import;     // import index in unit for IMP
+    int state;      // 0: unresolved, 1: resolving, 2: resolved
+    int resolved;
+} Export;
+
+typedef struct {
+    char path[0x100];
+    int size;
+    int fixed;
+    int addr;
+    int importcount;
+    char imports[MAX_IMPORTS][MAX_NAME];
+    unsigned char *data;
+} Unit;
+
+typedef struct {
+    int unit;
+    int offset;
+    int import;     // -1 for rel
+} Fixup;
+
+static Unit units[MAX_UNITS];
+static int unitcount = 0;
+static Export exports[MAX_SYMS];
+static int exportcount = 0;
+static Fixup fixups[MAX_FIXUPS];
+static int fixupcount = 0;
+
+static Export* findexport(const char *name)
+{
+    for (int i=0; i<exportcount; i++) {
+        if (strcmp(exports[i].name, name) == 0) {
+            return &exports[i];
+        }
+    }
+    return NULL;
+}
+
+static int addexport(int unit, const char *name, int kind, int val, int import)
+{
+    Export *e = findexport(name);
+    if (e != NULL) {
+        if (kind == EXP_ABS && e->kind == EXP_ABS) {
+            // first definition wins
+            return 0;
+        }
+        fprintf(stderr, "%s: duplicate symbol %s (first defined in %s)\n",
+            units[unit].path, name, units[e->unit].path);
+        return 1;
+    }
+    if (exportcount == MAX_SYMS) {
+        fprintf(stderr, "Too many symbols\n");
+        return 1;
+    }
+    e = &exports[exportcount++];
+    strncpy(e->name, name, MAX_NAME-1);
+    e->unit = unit;
+    e->kind = kind;
+    e->val = val;
+    e->import = import;
+    e->state = 0;
+    return 0;
+}
+
+static int loadunit(const char *path)
+{
+    if (unitcount == MAX_UNITS) {
+        fprintf(stderr, "Too many units\n");
+        return 1;
+    }
+    int u = unitcount++;
+    Unit *unit = &units[u];
+    strncpy(unit->path, path, sizeof(unit->path)-1);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return 1;
+    }
+    char line[0x100];
+    char name[MAX_NAME];
+    char kind[0x10];
+    int a, b;
+    if (fgets(line, sizeof(line), fp) == NULL || strcmp(line, "zobj\n") != 0) {
+        fprintf(stderr, "%s: not an object\n", path);
+        return 1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strcmp(line, "data\n") == 0) {
+            unit->data = malloc(unit->size);
+            if (fread(unit->data, 1, unit->size, fp) != (size_t)unit->size) {
+                fprintf(stderr, "%s: truncated\n", path);
+                return 1;
+            }
+            fclose(fp);
+            return 0;
+        }
+        if (sscanf(line, "size %x", &a) == 1) {
+            unit->size = a;
+        } else if (sscanf(line, "fixed %d", &a) == 1) {
+            unit->fixed = a;
+        } else if (sscanf(line, "import %x %63s", &a, name) == 2) {
+            if (a != unit->importcount || a == MAX_IMPORTS) {
+                fprintf(stderr, "%s: bad import\n", path);
+                return 1;
+            }
+            strcpy(unit->imports[unit->importcount++], name);
+        } else if (sscanf(line, "export %63s %15s %x %x", name, kind, &a, &b) >= 3) {
+            int res;
+            if (strcmp(kind, "abs") == 0) {
+                res = addexport(u, name, EXP_ABS, a, 0);
+            } else if (strcmp(kind, "rel") == 0) {
+                res = addexport(u, name, EXP_REL, a, 0);
+            } else {
+                res = addexport(u, name, EXP_IMP, a, b);
+            }
+            if (res != 0) {
+                return 1;
+            }
+        } else if (sscanf(line, "fixup %x %15s %x", &a, kind, &b) >= 2) {
+            if (fixupcount == MAX_FIXUPS) {
+                fprintf(stderr, "Too many fixups\n");
+                return 1;
+            }
+            Fixup *f = &fixups[fixupcount++];
+            f->unit = u;
+            f->offset = a;
+            f->import = strcmp(kind, "rel") == 0 ? -1 : b;
+        }
+    }
+    fprintf(stderr, "%s: truncated\n", path);
+    return 1;
+}
+
+static int resolve(Export *e, int *val);
+
+// Resolve import k of unit u
+static int resolveimport(int u, int k, int *val)
+{
+    const char *name = units[u].imports[k];
+    Export *e = findexport(name);
+    if (e == NULL) {
+        fprintf(stderr, "%s: undefined symbol %s\n", units[u].path, name);
+        return 1;
+    }
+    return resolve(e, val);
+}
+
+static int resolve(Export *e, int *val)
+{
+    if (e->state == 1) {
+        fprintf(stderr, "%s: circular definition of %s\n",
+            units[e->unit].path, e->name);
+        return 1;
+    }
+    if (e->state == 0) {
+        e->state = 1;
+        if (e->kind == EXP_ABS) {
+            e->resolved = e->val;
+        } else if (e->kind == EXP_REL) {
+            e->resolved = units[e->unit].addr + e->val;
+        } else {
+            int v;
+            if (resolveimport(e->unit, e->import, &v) != 0) {
+                return 1;
+            }
+            e->resolved = v + e->val;
+        }
+        e->resolved &= 0xffff;
+        e->state = 2;
+    }
+    *val = e->resolved;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int base = 0;
+    char *mappath = NULL;
+    int c;
+    while ((c = getopt(argc, argv, "b:m:")) != -1) {
+        switch (c) {
+        case 'b':
+            base = strtol(optarg, NULL, 0);
+            break;
+        case 'm':
+            mappath = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: zld [-b base] [-m mapfile] unit.zo...\n");
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: zld [-b base] [-m mapfile] unit.zo...\n");
+        return 1;
+    }
+    for (int i=optind; i<argc; i++) {
+        if (loadunit(argv[i]) != 0) {
+            return 1;
+        }
+    }
+    int addr = base;
+    for (int i=0; i<unitcount; i++) {
+        if (units[i].fixed && addr != 0) {
+            fprintf(stderr, "%s: unit can't be moved and must be linked at "
+                "address 0\n", units[i].path);
+            return 1;
+        }
+        units[i].addr = addr;
+        addr += units[i].size;
+    }
+    if (addr > 0x10000) {
+        fprintf(stderr, "Binary doesn't fit in 64K\n");
+        return 1;
+    }
+    for (int i=0; i<fixupcount; i++) {
+        Fixup *f = &fixups[i];
+        Unit *unit = &units[f->unit];
+        int v = unit->addr;
+        if (f->import >= 0) {
+            if (resolveimport(f->unit, f->import, &v) != 0) {
+                return 1;
+            }
+        }
+        unsigned char *p = unit->data + f->offset;
+        v += p[0] | (p[1] << 8);
+        p[0] = v & 0xff;
+        p[1] = (v >> 8) & 0xff;
+    }
+    for (int i=0; i<unitcount; i++) {
+        fwrite(units[i].data, units[i].size, 1, stdout);
+    }
+    if (mappath != NULL) {
+        FILE *fp = fopen(mappath, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "Can't open %s\n", mappath);
+            return 1;
+        }
+        for (int i=0; i<unitcount; i++) {
+            fprintf(fp, "%04x %04x %s\n", units[i].addr, units[i].size,
+                units[i].path);
+        }
+        for (int i=0; i<exportcount; i++) {
+            int v;
+            // unused imports chains with undefined symbols aren't an error
+            if (resolve(&exports[i], &v) == 0) {
+                fprintf(fp, "%04x %s\n", v, exports[i].name);
+            }
+        }
+        fclose(fp);
+    }
+    return 0;
+}
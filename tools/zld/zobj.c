@@ -0,0 +1,668 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <utime.h>
+#include <sys/wait.h>
+
+/* zobj assembles a single unit with zasm and spits a relocatable object.
+ *
+ * zasm itself only knows how to spit a flat binary. To know where a unit
+ * references its own labels and where it references symbols from other units,
+ * we assemble it several times with different values and look at which words
+ * change:
+ *
+ * 1. base run: unit at 0, imported symbols at 0.
+ * 2. import run: unit at 0, import k at 0x0101*(k+1).
+ * 3. reloc run: unit at ZOBJ_SHIFT, imported symbols at 0.
+ * 4. check run: unit at 0, import k at 0x0101*(nimports-k). This catches
+ *    expressions that mix more than one import, which we can't express.
+ *
+ * Names referenced by the unit but not defined by it (or by the files it
+ * includes) are imports. When a preceding object (-p) exports that name as an
+ * absolute value, we give it its real value instead: this is how constants
+ * like BLOCKDEV_SIZE or *_RAMEND flow from one unit to the next. Because zasm
+ * doesn't allow .equ forward references, constants always come from preceding
+ * units.
+ *
+ * Names a unit defines are exported, except for names defined in ".h" files,
+ * which are considered shared headers. Export values are obtained by appending
+ * a ".dw" trailer to the unit and going through the same process.
+ *
+ * When the inputs of an existing output object haven't changed, we don't
+ * assemble anything and only touch that object. Inputs are the unit, every file
+ * it pulls with .inc (at any level) or .bin, the values of imported constants
+ * and the assembler: zasm.sh and, next to it, emul/zasm/zasm. Because label imports are
+ * placeholders, changing code in a unit doesn't cause following units to be
+ * reassembled, only changing constants they use does.
+ *
+ * Usage: zobj [-p prev.zo]... [-o out.zo] unit.asm [incdir]...
+ *
+ * Include dirs are passed as-is to zasm.sh. The ZASM env var overrides the
+ * path to zasm.sh.
+ */
+
+#define ZOBJ_SHIFT 0x0101
+#define MAX_SYMS 0x400
+#define MAX_NAME 0x40
+#define MAX_INCS 0x20
+#define MAX_PREVS 0x40
+#define MAX_PATH 0x1000
+#define MAX_OUT 0x10000
+
+#define SYM_REF 0x01
+#define SYM_DEF 0x02
+#define SYM_HEADER 0x04
+#define SYM_IMPORT 0x08
+
+typedef struct {
+    char name[MAX_NAME];
+    int flags;
+    int import;     // index in imports, -1 if not a placeholder
+    int hasval;     // constant import with a known value
+    int val;
+} Sym;
+
+static Sym syms[MAX_SYMS];
+static int symcount = 0;
+static int imports[MAX_SYMS];
+static int importcount = 0;
+static int exports[MAX_SYMS];
+static int exportcount = 0;
+
+static char *incdirs[MAX_INCS];
+static int incdircount = 0;
+static char *prevs[MAX_PREVS];
+static int prevcount = 0;
+static uint64_t hash = 0xcbf29ce484222325ULL;
+static int hasorg = 0;
+
+static const char *reserved[] = {
+    "a", "b", "c", "d", "e", "h", "l", "i", "r", "af", "bc", "de", "hl", "ix",
+    "iy", "sp", "nz", "z", "nc", "po", "pe", "p", "m", NULL
+};
+
+static void hashbuf(const char *buf, long len)
+{
+    for (long i=0; i<len; i++) {
+        hash ^= (unsigned char)buf[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+static char *readfile(const char *path, long *len)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    char *buf = malloc(size+1);
+    fread(buf, size, 1, fp);
+    fclose(fp);
+    buf[size] = '\0';
+    if (len != NULL) {
+        *len = size;
+    }
+    return buf;
+}
+
+static int isreserved(const char *name)
+{
+    for (int i=0; reserved[i] != NULL; i++) {
+        if (strcasecmp(name, reserved[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static Sym* getsym(const char *name)
+{
+    for (int i=0; i<symcount; i++) {
+        if (strcmp(syms[i].name, name) == 0) {
+            return &syms[i];
+        }
+    }
+    if (symcount == MAX_SYMS) {
+        fprintf(stderr, "Too many symbols\n");
+        exit(1);
+    }
+    Sym *s = &syms[symcount++];
+    strncpy(s->name, name, MAX_NAME-1);
+    s->flags = 0;
+    s->import = -1;
+    s->hasval = 0;
+    return s;
+}
+
+static int isidentc(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Reads the next whitespace-separated word in (*s) into word, advancing *s.
+static void nextword(char **s, char *word)
+{
+    int i = 0;
+    while (**s == ' ' || **s == '\t') {
+        (*s)++;
+    }
+    while (**s != '\0' && **s != ' ' && **s != '\t') {
+        if (i < MAX_NAME-1) {
+            word[i++] = **s;
+        }
+        (*s)++;
+    }
+    word[i] = '\0';
+}
+
+// Flag all identifiers in s as references
+static void scanrefs(char *s)
+{
+    char name[MAX_NAME];
+    while (*s != '\0') {
+        if (*s == '"') {
+            s++;
+            while (*s != '\0' && *s != '"') {
+                s++;
+            }
+            if (*s != '\0') {
+                s++;
+            }
+        } else if (*s == '\'') {
+            // char literal is always 3 chars: 'X'
+            s++;
+            if (*s != '\0') {
+                s++;
+            }
+            if (*s == '\'') {
+                s++;
+            }
+        } else if (isdigit((unsigned char)*s) || *s == '.') {
+            // numbers and local labels
+            s++;
+            while (isidentc(*s)) {
+                s++;
+            }
+        } else if (isidentc(*s)) {
+            int i = 0;
+            while (isidentc(*s)) {
+                if (i < MAX_NAME-1) {
+                    name[i++] = *s;
+                }
+                s++;
+            }
+            name[i] = '\0';
+            // ex af, af'
+            if (*s == '\'') {
+                s++;
+            }
+            if (!isreserved(name)) {
+                getsym(name)->flags |= SYM_REF;
+            }
+        } else {
+            s++;
+        }
+    }
+}
+
+static char *findinc(const char *name)
+{
+    static char path[MAX_PATH];
+    for (int i=0; i<incdircount; i++) {
+        snprintf(path, MAX_PATH, "%s/%s", incdirs[i], name);
+        if (access(path, R_OK) == 0) {
+            return path;
+        }
+    }
+    return NULL;
+}
+
+static int scanfile(const char *path, int toplevel);
+
+// Adds the path and the contents of a file to the hash. Returns 0 on success.
+static int hashfile(const char *path)
+{
+    long len;
+    char *buf = readfile(path, &len);
+    if (buf == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return 1;
+    }
+    hashbuf(path, strlen(path));
+    hashbuf(buf, len);
+    free(buf);
+    return 0;
+}
+
+// Hashes the file included by a .inc or .bin argument, if we find it.
+static int hashinc(char *word)
+{
+    int len = strlen(word);
+    if (len < 3 || word[0] != '"' || word[len-1] != '"') {
+        return 0;   // let zasm complain
+    }
+    word[len-1] = '\0';
+    char *incpath = findinc(word+1);
+    if (incpath == NULL) {
+        return 0;   // let zasm complain
+    }
+    return hashfile(incpath);
+}
+
+// Scans a single statement, that is, a line or a part of a line separated
+// by "\".
+static int scanstmt(char *s, int isheader, int toplevel)
+{
+    char word[MAX_NAME];
+    nextword(&s, word);
+    int len = strlen(word);
+    if (len > 1 && word[len-1] == ':') {
+        word[len-1] = '\0';
+        if (word[0] != '.') {
+            Sym *sym = getsym(word);
+            sym->flags |= SYM_DEF;
+            if (isheader) {
+                sym->flags |= SYM_HEADER;
+            }
+        }
+        nextword(&s, word);
+    }
+    if (strcasecmp(word, ".equ") == 0) {
+        nextword(&s, word);
+        Sym *sym = getsym(word);
+        sym->flags |= SYM_DEF;
+        if (isheader) {
+            sym->flags |= SYM_HEADER;
+        }
+        scanrefs(s);
+    } else if (strcasecmp(word, ".inc") == 0) {
+        nextword(&s, word);
+        if (!toplevel) {
+            // zasm doesn't allow it, but a stale object would be worse than
+            // a zasm error.
+            return hashinc(word);
+        }
+        len = strlen(word);
+        if (len < 3 || word[0] != '"' || word[len-1] != '"') {
+            return 0;   // let zasm complain
+        }
+        word[len-1] = '\0';
+        char *incpath = findinc(word+1);
+        if (incpath == NULL) {
+            fprintf(stderr, "Can't find include %s\n", word+1);
+            return 1;
+        }
+        return scanfile(incpath, 0);
+    } else if (strcasecmp(word, ".org") == 0) {
+        hasorg = 1;
+    } else if (strcasecmp(word, ".bin") == 0) {
+        nextword(&s, word);
+        return hashinc(word);
+    } else {
+        scanrefs(s);
+    }
+    return 0;
+}
+
+static int scanfile(const char *path, int toplevel)
+{
+    long len;
+    char *buf = readfile(path, &len);
+    if (buf == NULL) {
+        fprintf(stderr, "Can't open %s\n", path);
+        return 1;
+    }
+    hashbuf(path, strlen(path));
+    hashbuf(buf, len);
+    int plen = strlen(path);
+    int isheader = plen > 2 && strcmp(path+plen-2, ".h") == 0;
+    char *line = buf;
+    while (line != NULL && *line != '\0') {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        // strip comment and split statements, outside of quotes
+        char *stmt = line;
+        int inquote = 0;
+        for (char *s=line; ; s++) {
+            if (*s == '"') {
+                inquote = !inquote;
+            } else if (!inquote && *s == '\'' && s[1] != '\0' && s[2] == '\''
+                    && (s == line || !isidentc(s[-1]))) {
+                s += 2;
+            } else if (!inquote && (*s == ';' || *s == '\\' || *s == '\0'
+                    || *s == '\r')) {
+                char c = *s;
+                *s = '\0';
+                if (scanstmt(stmt, isheader, toplevel) != 0) {
+                    return 1;
+                }
+                if (c != '\\') {
+                    break;
+                }
+                stmt = s+1;
+            }
+        }
+        line = next;
+    }
+    free(buf);
+    return 0;
+}
+
+// Look for name in preceding objects. If it's exported there as an absolute
+// value, set it in val and return 1.
+static int prevabs(const char *name, int *val)
+{
+    char line[0x100];
+    char ename[MAX_NAME];
+    char kind[0x10];
+    int v;
+    for (int i=0; i<prevcount; i++) {
+        FILE *fp = fopen(prevs[i], "r");
+        if (fp == NULL) {
+            fprintf(stderr, "Can't open %s\n", prevs[i]);
+            exit(1);
+        }
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (strcmp(line, "data\n") == 0) {
+                break;
+            }
+            if (sscanf(line, "export %63s %15s %x", ename, kind, &v) == 3) {
+                if (strcmp(ename, name) == 0 && strcmp(kind, "abs") == 0) {
+                    fclose(fp);
+                    *val = v;
+                    return 1;
+                }
+            }
+        }
+        fclose(fp);
+    }
+    return 0;
+}
+
+// Assembles unit with the specified base and import values and returns
+// output length or -1 on error. mode: 0 = all imports at 0, 1 = increasing
+// import values, 2 = decreasing.
+static int assemble(const char *zasm, const char *unit, int base, int mode,
+    unsigned char *out)
+{
+    char srcpath[] = "/tmp/zobjsrcXXXXXX";
+    char outpath[] = "/tmp/zobjoutXXXXXX";
+    int fd = mkstemp(srcpath);
+    FILE *fp = fdopen(fd, "w");
+    fprintf(fp, ".org 0x%04x\n", base);
+    for (int i=0; i<symcount; i++) {
+        Sym *s = &syms[i];
+        if (!(s->flags & SYM_IMPORT)) {
+            continue;
+        }
+        int v = 0;
+        if (s->hasval) {
+            v = s->val;
+        } else if (mode == 1) {
+            v = 0x0101 * (s->import+1);
+        } else if (mode == 2) {
+            v = 0x0101 * (importcount-s->import);
+        }
+        fprintf(fp, ".equ %s 0x%04x\n", s->name, v);
+    }
+    long len;
+    char *src = readfile(unit, &len);
+    fwrite(src, len, 1, fp);
+    free(src);
+    fputs("\n", fp);
+    for (int i=0; i<exportcount; i++) {
+        fprintf(fp, ".dw %s\n", syms[exports[i]].name);
+    }
+    fclose(fp);
+    fd = mkstemp(outpath);
+    close(fd);
+    char cmd[MAX_PATH*2];
+    int n = snprintf(cmd, sizeof(cmd), "\"%s\"", zasm);
+    for (int i=0; i<incdircount; i++) {
+        n += snprintf(cmd+n, sizeof(cmd)-n, " \"%s\"", incdirs[i]);
+    }
+    snprintf(cmd+n, sizeof(cmd)-n, " < %s > %s", srcpath, outpath);
+    int res = system(cmd);
+    unlink(srcpath);
+    if (res != 0) {
+        unlink(outpath);
+        return -1;
+    }
+    fp = fopen(outpath, "r");
+    int outlen = fread(out, 1, MAX_OUT, fp);
+    fclose(fp);
+    unlink(outpath);
+    return outlen;
+}
+
+static uint16_t getword(unsigned char *buf, int i)
+{
+    return buf[i] | (buf[i+1] << 8);
+}
+
+// Returns the import index corresponding to the deltas in the two import runs,
+// -1 if they don't match any single import.
+static int whichimport(uint16_t d1, uint16_t d3)
+{
+    if (d1 % 0x0101 != 0) {
+        return -1;
+    }
+    int k = (d1 / 0x0101) - 1;
+    if (k < 0 || k >= importcount) {
+        return -1;
+    }
+    if (d3 != 0x0101 * (importcount-k)) {
+        return -1;
+    }
+    return k;
+}
+
+// Returns whether existing object at path has been made from the same inputs.
+static int uptodate(const char *path, uint64_t h)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    char line[0x100];
+    unsigned long long prevhash = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "hash %llx", &prevhash) == 1) {
+            break;
+        }
+    }
+    fclose(fp);
+    return prevhash == h;
+}
+
+int main(int argc, char *argv[])
+{
+    char *outpath = NULL;
+    int c;
+    while ((c = getopt(argc, argv, "p:o:")) != -1) {
+        switch (c) {
+        case 'p':
+            if (prevcount == MAX_PREVS) {
+                fprintf(stderr, "Too many preceding objects\n");
+                return 1;
+            }
+            prevs[prevcount++] = optarg;
+            break;
+        case 'o':
+            outpath = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: zobj [-p prev.zo]... [-o out.zo] unit.asm [incdir]...\n");
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: zobj [-p prev.zo]... [-o out.zo] unit.asm [incdir]...\n");
+        return 1;
+    }
+    char *unit = argv[optind++];
+    while (optind < argc) {
+        if (incdircount == MAX_INCS) {
+            fprintf(stderr, "Too many include dirs\n");
+            return 1;
+        }
+        incdirs[incdircount++] = argv[optind++];
+    }
+    char zasm[MAX_PATH];
+    if (getenv("ZASM") != NULL) {
+        strncpy(zasm, getenv("ZASM"), MAX_PATH-1);
+    } else {
+        char self[MAX_PATH];
+        strncpy(self, argv[0], MAX_PATH-1);
+        snprintf(zasm, MAX_PATH, "%s/../zasm.sh", dirname(self));
+    }
+
+    if (hashfile(zasm) != 0) {
+        return 1;
+    }
+    char zasmdir[MAX_PATH] = {0};
+    char zasmbin[MAX_PATH];
+    strncpy(zasmdir, zasm, MAX_PATH-1);
+    snprintf(zasmbin, MAX_PATH, "%s/emul/zasm/zasm", dirname(zasmdir));
+    if (access(zasmbin, R_OK) == 0 && hashfile(zasmbin) != 0) {
+        return 1;
+    }
+    if (scanfile(unit, 1) != 0) {
+        return 1;
+    }
+    if (hasorg) {
+        fprintf(stderr, "%s: units can't use .org, it's zld's job\n", unit);
+        return 1;
+    }
+    for (int i=0; i<symcount; i++) {
+        Sym *s = &syms[i];
+        if (s->flags & SYM_DEF) {
+            if (!(s->flags & SYM_HEADER)) {
+                exports[exportcount++] = i;
+            }
+        } else if (s->flags & SYM_REF) {
+            s->flags |= SYM_IMPORT;
+            if (prevabs(s->name, &s->val)) {
+                s->hasval = 1;
+            } else {
+                s->import = importcount;
+                imports[importcount++] = i;
+            }
+            char buf[MAX_NAME+0x10];
+            int n = snprintf(buf, sizeof(buf), "%s %d %x\n", s->name,
+                s->hasval, s->hasval ? s->val : s->import);
+            hashbuf(buf, n);
+        }
+    }
+    if (importcount > 0xfe) {
+        fprintf(stderr, "%s: too many imports\n", unit);
+        return 1;
+    }
+    if (outpath != NULL && uptodate(outpath, hash)) {
+        // Let make know that we're up to date.
+        utime(outpath, NULL);
+        return 0;
+    }
+
+    static unsigned char base[MAX_OUT], imp[MAX_OUT], reloc[MAX_OUT], chk[MAX_OUT];
+    int len = assemble(zasm, unit, 0, 0, base);
+    if (len < 0) {
+        fprintf(stderr, "%s: assembly failed. Line numbers are offset by %d "
+            "lines of imports.\n", unit, symcount+1);
+        return 1;
+    }
+    int len1 = assemble(zasm, unit, 0, 1, imp);
+    int len3 = assemble(zasm, unit, 0, 2, chk);
+    if (len1 != len || len3 != len) {
+        fprintf(stderr, "%s: imported symbols must only be used as full "
+            "words\n", unit);
+        return 1;
+    }
+    // If moving the unit changes its size (.fill with "$"), it can't move.
+    int fixed = assemble(zasm, unit, ZOBJ_SHIFT, 0, reloc) != len;
+    int size = len - exportcount*2;
+
+    FILE *fp = stdout;
+    char tmppath[MAX_PATH];
+    if (outpath != NULL) {
+        snprintf(tmppath, MAX_PATH, "%s.tmp", outpath);
+        fp = fopen(tmppath, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "Can't open %s\n", tmppath);
+            return 1;
+        }
+    }
+    fprintf(fp, "zobj\n");
+    fprintf(fp, "unit %s\n", unit);
+    fprintf(fp, "hash %016llx\n", (unsigned long long)hash);
+    fprintf(fp, "size %x\n", size);
+    fprintf(fp, "fixed %d\n", fixed);
+    for (int i=0; i<importcount; i++) {
+        fprintf(fp, "import %x %s\n", i, syms[imports[i]].name);
+    }
+    int err = 0;
+    for (int i=0; i<len; ) {
+        if (base[i] == imp[i] && base[i] == chk[i]
+                && (fixed || base[i] == reloc[i])) {
+            i++;
+            continue;
+        }
+        if (i+1 >= len) {
+            err = 1;
+            break;
+        }
+        uint16_t w0 = getword(base, i);
+        uint16_t d1 = getword(imp, i) - w0;
+        uint16_t d2 = fixed ? 0 : getword(reloc, i) - w0;
+        uint16_t d3 = getword(chk, i) - w0;
+        int k = whichimport(d1, d3);
+        if (i >= size) {
+            // export trailer
+            Sym *s = &syms[exports[(i-size)/2]];
+            if (d2 == ZOBJ_SHIFT && d1 == 0 && d3 == 0) {
+                fprintf(fp, "export %s rel %x\n", s->name, w0);
+            } else if (d2 == 0 && k >= 0) {
+                fprintf(fp, "export %s imp %x %x\n", s->name, w0, k);
+            } else {
+                fprintf(stderr, "%s: can't export %s\n", unit, s->name);
+                err = 1;
+            }
+            exports[(i-size)/2] = -1;
+        } else if (d2 == ZOBJ_SHIFT && d1 == 0 && d3 == 0) {
+            fprintf(fp, "fixup %x rel\n", i);
+        } else if (d2 == 0 && k >= 0) {
+            fprintf(fp, "fixup %x imp %x\n", i, k);
+        } else {
+            fprintf(stderr, "%s: can't relocate word at offset 0x%x\n", unit, i);
+            err = 1;
+        }
+        i += 2;
+    }
+    // Remaining exports are absolute
+    for (int i=0; i<exportcount; i++) {
+        if (exports[i] >= 0) {
+            fprintf(fp, "export %s abs %x\n", syms[exports[i]].name,
+                getword(base, size+i*2));
+        }
+    }
+    fprintf(fp, "data\n");
+    fwrite(base, size, 1, fp);
+    if (outpath != NULL) {
+        fclose(fp);
+        if (err) {
+            unlink(tmppath);
+        } else {
+            rename(tmppath, outpath);
+        }
+    }
+    return err;
+}